@@ -0,0 +1,115 @@
+#include "Background.h"
+
+/**
+ * The constructor for Background
+ *
+ * warmupFrames is the number of frames averaged before the model is ready,
+ * and learningRate is how much weight each later frame gets
+ */
+
+Background::Background(int warmupFrames, double learningRate) :
+    _warmupFrames(warmupFrames),
+    _learningRate(learningRate),
+    _frames(0)
+{}
+
+/**
+ * The destructor for Background
+ *
+ * As of now this does nothing
+ */
+
+Background::~Background()
+{}
+
+/**
+ * Adds a frame to the model
+ *
+ * During the warm up, frame n is weighted by 1 / (n + 1) so the mean is a
+ * plain average, and the mask is ignored since nobody should be in front of
+ * the camera yet. Afterwards the weight is the learning rate, and pixels
+ * where handMask is non zero are left untouched
+ *
+ * The variance is updated from the difference to the mean before the mean
+ * moves, which keeps the whole update a few passes over the frame
+ *
+ * A mask smaller than the frame, from a Preprocess at a pyramid level, is
+ * scaled up to it first. The mask is blurred past the edge of the hand, which
+ * covers the half a pixel of the level the interpolation may shift it by
+ */
+
+void Background::update(const Mat& frame, const Mat& handMask)
+{
+    frame.convertTo(_frame, CV_32F);
+
+    if (_frames == 0) {
+        _frame.copyTo(_mean);
+        _variance.create(_frame.size(), _frame.type());
+        _variance.setTo(Scalar::all(0));
+        ++_frames;
+        return;
+    }
+
+    bool warmingUp = !isReady();
+    double alpha = warmingUp ? 1.0 / (_frames + 1) : _learningRate;
+
+    // only learn where the hand is not
+    Mat mask;
+    if (!warmingUp && !handMask.empty()) {
+        const Mat* hand = &handMask;
+        if (handMask.size() != frame.size()) {
+            resize(handMask, _hand, frame.size(), 0, 0, INTER_LINEAR);
+            hand = &_hand;
+        }
+
+        compare(*hand, 0, _still, CMP_EQ);
+        mask = _still;
+    }
+
+    subtract(_frame, _mean, _diff);
+    multiply(_diff, _diff, _diff);
+    accumulateWeighted(_diff, _variance, alpha, mask);
+    accumulateWeighted(_frame, _mean, alpha, mask);
+
+    ++_frames;
+}
+
+/**
+ * The model is ready once it has averaged the warm up frames
+ */
+
+bool Background::isReady() const
+{
+    return _frames >= _warmupFrames;
+}
+
+/**
+ * Returns the number of frames the model has seen
+ */
+
+int Background::frames() const
+{
+    return _frames;
+}
+
+/**
+ * Returns the mean of the model as an 8 bit image, the same type as the frames
+ *
+ * The image is converted into the same buffer every time, so callers that
+ * keep it across requests should copy it
+ */
+
+const Mat& Background::background() const
+{
+    _mean.convertTo(_background, CV_8U);
+    return _background;
+}
+
+/**
+ * Returns the per pixel variance, as 32 bit floats
+ */
+
+const Mat& Background::variance() const
+{
+    return _variance;
+}
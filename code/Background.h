@@ -0,0 +1,66 @@
+#ifndef BACKGROUND_H
+#define BACKGROUND_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv/cv.h>
+
+/**
+ * The Background class
+ *
+ * This is a running model of the static background behind the hand
+ *
+ * Each pixel keeps a running mean and variance. For the first few frames
+ * (the warm up) every frame is averaged in equally, the same way
+ * getBackground used to do it. Once warmed up, the model keeps learning at a
+ * fixed rate, but only from the pixels that are not covered by the hand, so
+ * slow lighting changes are followed without the hand bleeding into the model
+ */
+
+using namespace cv;
+
+class Background
+{
+    private:
+        Mat _mean;
+        Mat _variance;
+
+        // scratch buffers reused between frames
+        Mat _frame;
+        Mat _diff;
+        Mat _hand;
+        Mat _still;
+
+        // the 8 bit background handed out, converted into on every request
+        mutable Mat _background;
+
+        const int _warmupFrames;
+        const double _learningRate;
+        int _frames;
+
+    public:
+        Background(int warmupFrames = 60, double learningRate = 0.01);
+        ~Background();
+
+        // adds a frame to the model, skipping the non zero pixels of the mask,
+        // which may be at a pyramid level of the frame
+        void update(const Mat& frame, const Mat& handMask = Mat());
+
+        // true once the warm up frames have been seen
+        bool isReady() const;
+
+        // the number of frames seen so far
+        int frames() const;
+
+        // the current background as an 8 bit image, valid until the next request
+        const Mat& background() const;
+
+        // the per pixel variance of the background
+        const Mat& variance() const;
+};
+
+#endif // BACKGROUND_H
@@ -0,0 +1,445 @@
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// the stage benchmarks reach into the workspace of Detect the same way
+// TestDetect does, to recycle what a stage fills between iterations
+#define private public
+
+#include "Detect.h"
+#include "Preprocess.h"
+#include "Segment.h"
+
+/**
+ * The microbenchmarks of the stages of Detect and Preprocess
+ *
+ * Every benchmark runs on each of the inputs below, the two recorded hand
+ * masks TestDetect uses and a synthetic hand drawn at 480p, 720p and 1080p,
+ * so a change can be judged on the frame sizes a camera actually gives. The
+ * stages are fed what the stage before them gives on the same input, worked
+ * out once up front, and each stage is timed on its own
+ *
+ * Run with --benchmark_format=json or --benchmark_out=<file> for machine
+ * readable output, make bench-detect does the latter
+ */
+
+// ======
+// inputs
+// ======
+
+enum BenchInput {
+    INPUT_TEST_HAND,
+    INPUT_TEST_HAND_1,
+    INPUT_SYNTHETIC_480P,
+    INPUT_SYNTHETIC_720P,
+    INPUT_SYNTHETIC_1080P,
+    INPUT_COUNT
+};
+
+static const char* inputNames[INPUT_COUNT] = {
+    "TestHand.png", "TestHand1.png", "synthetic 480p", "synthetic 720p", "synthetic 1080p"
+};
+
+static const char* engineNames[] = { "grid", "dt", "c2f" };
+
+/**
+ * draws a hand the way Preprocess leaves it, a white palm with five fingers
+ * on black, blurred at the edges
+ *
+ * The hand is laid out on a 640x480 frame and scaled to the height given,
+ * centered across the width
+ */
+
+static Mat syntheticHand(const Size& size)
+{
+    double scale = size.height / 480.0;
+    Point2f offset((float)((size.width - 640 * scale) / 2), 0);
+
+    Mat mask = Mat::zeros(size, CV_8U);
+
+    // the palm and the wrist below it
+    Point palm = Point(320, 330) * scale + Point(offset);
+    ellipse(mask, palm, Size(cvRound(85 * scale), cvRound(95 * scale)), 0, 0, 360, Scalar(255), -1);
+    rectangle(mask, palm + Point(cvRound(-60 * scale), cvRound(60 * scale)),
+              Point(palm.x + cvRound(60 * scale), size.height - 1), Scalar(255), -1);
+
+    // the thumb out to the side, the four fingers up
+    Point tips[] = { Point(170, 260), Point(240, 110), Point(300, 80), Point(360, 90), Point(420, 140) };
+    for (int i = 0; i < 5; ++i) {
+        Point tip = tips[i] * scale + Point(offset);
+        line(mask, palm, tip, Scalar(255), cvRound(34 * scale));
+        circle(mask, tip, cvRound(17 * scale), Scalar(255), -1);
+    }
+
+    GaussianBlur(mask, mask, Size(7, 7), 1.8, 1.8);
+    return mask;
+}
+
+/**
+ * returns the hand mask of an input, read or drawn on first use
+ */
+
+static const Mat& handMask(int input)
+{
+    static Mat masks[INPUT_COUNT];
+    Mat& mask = masks[input];
+
+    if (mask.empty()) {
+        switch (input) {
+            case INPUT_TEST_HAND:
+                cvtColor(imread("TestHand.png"), mask, CV_BGR2GRAY);
+                break;
+            case INPUT_TEST_HAND_1:
+                cvtColor(imread("TestHand1.png"), mask, CV_BGR2GRAY);
+                break;
+            case INPUT_SYNTHETIC_480P:
+                mask = syntheticHand(Size(640, 480));
+                break;
+            case INPUT_SYNTHETIC_720P:
+                mask = syntheticHand(Size(1280, 720));
+                break;
+            case INPUT_SYNTHETIC_1080P:
+                mask = syntheticHand(Size(1920, 1080));
+                break;
+        }
+    }
+    return mask;
+}
+
+/**
+ * a camera frame and a background to go with an input, for Preprocess
+ *
+ * The background is a noisy gray wall, and the frame is the same wall with
+ * the hand mask painted over it in a skin tone
+ */
+
+static void cameraFrame(int input, Mat& frame, Mat& background)
+{
+    const Mat& mask = handMask(input);
+
+    background.create(mask.size(), CV_8UC3);
+    randn(background, Scalar::all(110), Scalar::all(6));
+
+    background.copyTo(frame);
+    frame.setTo(Scalar(120, 150, 200), mask > 127);
+}
+
+/**
+ * what every stage of Detect gets from the stages before it, for one input
+ */
+
+struct DetectInput
+{
+    vector<vector<Point>> polyCurves;
+    std::pair<Point, double> palm;
+    vector<vector<Point>> goodPolyCurves;
+    vector<vector<int>> hullIndices;
+    vector<Vec4i> defects;
+    vector<Point> defectEnds;
+};
+
+/**
+ * runs the stages of findHand on an input, keeping what each one gives
+ */
+
+static const DetectInput& detectInput(int input)
+{
+    static DetectInput inputs[INPUT_COUNT];
+    static bool ready[INPUT_COUNT];
+    DetectInput& in = inputs[input];
+
+    if (!ready[input]) {
+        Detect d;
+        Mat frame = handMask(input).clone();
+
+        in.polyCurves = d.getPolyCurves(frame);
+        in.palm = d.findMaxInscribedCircle(in.polyCurves, frame);
+        d.getRegionOfInterest(in.goodPolyCurves, in.polyCurves, in.palm);
+        in.hullIndices = d.getConvexHulls(in.goodPolyCurves);
+
+        if (!in.goodPolyCurves.empty()) {
+            convexityDefects(in.goodPolyCurves[0], in.hullIndices[0], in.defects);
+
+            const vector<Vec4i>& defects = d.filterDefects(in.defects);
+            for (size_t j = 0; j < defects.size(); ++j) {
+                const vector<Point>& curve = in.goodPolyCurves[0];
+                if (d.euclideanDist(curve[defects[j][2]], curve[defects[j][0]]) > in.palm.second) {
+                    in.defectEnds.push_back(curve[defects[j][0]]);
+                    in.defectEnds.push_back(curve[defects[j][1]]);
+                }
+            }
+        }
+        ready[input] = true;
+    }
+    return in;
+}
+
+/**
+ * labels a run with its input, and counts the pixels of the input as the
+ * bytes processed, so the throughput of the stages that touch every pixel
+ * can be compared across frame sizes
+ */
+
+static void describe(benchmark::State& state, int input, bool pixels)
+{
+    state.SetLabel(inputNames[input]);
+    if (pixels) {
+        state.SetBytesProcessed((int64_t)state.iterations() * handMask(input).total());
+    }
+}
+
+/**
+ * every input, as the only argument
+ */
+
+static void allInputs(benchmark::internal::Benchmark* b)
+{
+    b->ArgName("input");
+    for (int i = 0; i < INPUT_COUNT; ++i) {
+        b->Arg(i);
+    }
+}
+
+/**
+ * every input with every palm engine
+ */
+
+static void allInputsAndEngines(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"input", "engine"});
+    for (int i = 0; i < INPUT_COUNT; ++i) {
+        for (int engine = PALM_GRID; engine <= PALM_COARSE_TO_FINE; ++engine) {
+            b->Args({i, engine});
+        }
+    }
+}
+
+/**
+ * every input at every pyramid level
+ */
+
+static void allInputsAndLevels(benchmark::internal::Benchmark* b)
+{
+    b->ArgNames({"input", "level"});
+    for (int i = 0; i < INPUT_COUNT; ++i) {
+        for (int level = 0; level <= 2; ++level) {
+            b->Args({i, level});
+        }
+    }
+}
+
+// ======
+// Detect
+// ======
+
+/**
+ * getPolyCurves, findContours eats its input so every iteration gets a fresh
+ * copy of the mask, outside of the timing
+ */
+
+static void BM_getPolyCurves(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    const Mat& mask = handMask(input);
+    Mat frame;
+    Detect d;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        mask.copyTo(frame);
+        state.ResumeTiming();
+
+        benchmark::DoNotOptimize(d.getPolyCurves(frame).size());
+    }
+    describe(state, input, true);
+}
+BENCHMARK(BM_getPolyCurves)->Apply(allInputs)->Unit(benchmark::kMicrosecond);
+
+/**
+ * getConvexHulls of the curves around the palm
+ */
+
+static void BM_getConvexHulls(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    vector<vector<Point>> curves = detectInput(input).goodPolyCurves;
+    Detect d;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(d.getConvexHulls(curves).size());
+    }
+    describe(state, input, false);
+}
+BENCHMARK(BM_getConvexHulls)->Apply(allInputs)->Unit(benchmark::kMicrosecond);
+
+/**
+ * findMaxInscribedCircle, with each palm engine
+ */
+
+static void BM_findMaxInscribedCircle(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    PalmEngine engine = (PalmEngine)state.range(1);
+    const DetectInput& in = detectInput(input);
+    const Mat& mask = handMask(input);
+    Detect d(engine);
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(d.findMaxInscribedCircle(in.polyCurves, mask).second);
+    }
+    describe(state, input, false);
+    state.SetLabel(std::string(inputNames[input]) + " " + engineNames[engine]);
+    state.counters["polygonTests"] = d.polygonTests();
+}
+BENCHMARK(BM_findMaxInscribedCircle)->Apply(allInputsAndEngines)->Unit(benchmark::kMicrosecond);
+
+/**
+ * getRegionOfInterest, handing the curves back to the detector's pool after
+ * every iteration the way findHand does
+ */
+
+static void BM_getRegionOfInterest(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    const DetectInput& in = detectInput(input);
+    vector<vector<Point>> good;
+    Detect d;
+
+    for (auto _ : state) {
+        d._pointPool.clear(good);
+        d.getRegionOfInterest(good, in.polyCurves, in.palm);
+        benchmark::DoNotOptimize(good.size());
+    }
+    describe(state, input, false);
+}
+BENCHMARK(BM_getRegionOfInterest)->Apply(allInputs)->Unit(benchmark::kMicrosecond);
+
+/**
+ * filterDefects on the raw convexity defects of the hand
+ */
+
+static void BM_filterDefects(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    const DetectInput& in = detectInput(input);
+    Detect d;
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(d.filterDefects(in.defects).size());
+    }
+    describe(state, input, false);
+    state.counters["defects"] = (double)in.defects.size();
+}
+BENCHMARK(BM_filterDefects)->Apply(allInputs);
+
+/**
+ * findFingerTips on the ends of the defects deep enough to be between fingers
+ */
+
+static void BM_findFingerTips(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    const DetectInput& in = detectInput(input);
+    Detect d;
+    size_t tips = 0;
+
+    for (auto _ : state) {
+        tips = d.findFingerTips(in.defectEnds, in.palm).size();
+        benchmark::DoNotOptimize(tips);
+    }
+    describe(state, input, false);
+    state.counters["tips"] = (double)tips;
+}
+BENCHMARK(BM_findFingerTips)->Apply(allInputs);
+
+// ==========
+// Preprocess
+// ==========
+
+/**
+ * thresholdFilter on the background difference of a camera frame, restored
+ * outside of the timing since the planes are filtered in place
+ */
+
+static void BM_thresholdFilter(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    Mat frame, background, ycrcbFrame, ycrcbBackground;
+    cameraFrame(input, frame, background);
+    cvtColor(frame, ycrcbFrame, CV_BGR2YCrCb);
+    cvtColor(background, ycrcbBackground, CV_BGR2YCrCb);
+
+    Mat difference[3], planes[3];
+    thresholdDifference(ycrcbFrame, ycrcbBackground, Scalar::all(-1), difference);
+
+    Preprocess p(background);
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (int i = 0; i < 3; ++i) {
+            difference[i].copyTo(planes[i]);
+        }
+        state.ResumeTiming();
+
+        p.thresholdFilter(planes);
+        benchmark::DoNotOptimize(planes[0].data);
+    }
+    describe(state, input, true);
+}
+BENCHMARK(BM_thresholdFilter)->Apply(allInputs)->Unit(benchmark::kMicrosecond)->UseRealTime();
+
+/**
+ * the whole of Preprocess, from a camera frame to the hand mask, at each
+ * pyramid level
+ */
+
+static void BM_preprocess(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    Mat frame, background;
+    cameraFrame(input, frame, background);
+
+    Preprocess p(background);
+    p.setPyramidLevel((int)state.range(1));
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(p(frame).data);
+    }
+    describe(state, input, true);
+    state.SetLabel(std::string(inputNames[input]) + " level " + std::to_string(state.range(1)));
+}
+BENCHMARK(BM_preprocess)->Apply(allInputsAndLevels)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+/**
+ * Preprocess and then Detect at each pyramid level, mapping the hands back
+ * to full resolution, which is what a frame costs the pipeline
+ */
+
+static void BM_preprocessAndDetect(benchmark::State& state)
+{
+    int input = (int)state.range(0);
+    Mat frame, background, contours;
+    cameraFrame(input, frame, background);
+
+    Preprocess p(background);
+    Detect d(PALM_DISTANCE_TRANSFORM, 1);
+    p.setPyramidLevel((int)state.range(1));
+    d.setPyramidLevel(p.pyramidLevel());
+
+    vector<Hand> hands;
+    for (auto _ : state) {
+        const Mat& mask = p(frame);
+        mask.copyTo(contours);
+
+        hands = d.findHands(contours);
+        for (size_t i = 0; i < hands.size(); ++i) {
+            d.toFullResolution(hands[i], mask);
+        }
+        benchmark::DoNotOptimize(hands.size());
+    }
+    describe(state, input, true);
+    state.SetLabel(std::string(inputNames[input]) + " level " + std::to_string(state.range(1)));
+}
+BENCHMARK(BM_preprocessAndDetect)->Apply(allInputsAndLevels)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+BENCHMARK_MAIN();
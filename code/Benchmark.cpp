@@ -0,0 +1,121 @@
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+
+#include "Detect.h"
+#include "Preprocess.h"
+#include "Replay.h"
+#include "RoiTracker.h"
+#include "Trace.h"
+
+/**
+ * prints one row of the latency table
+ */
+
+void printStage(const char* name, const LatencyStats& stats)
+{
+    printf("%-12s %10.3f %10.3f %10.3f %10.3f\n", name,
+           stats.percentile(50), stats.percentile(95), stats.percentile(99),
+           stats.count() > 0 ? stats.total() / stats.count() : 0.0);
+}
+
+/**
+ * the headless benchmark
+ *
+ * this replays a recorded video (or image sequence) against a stored
+ * background, running the same Preprocess and Detect calls as main in
+ * HandMade.cpp, but without any windows or key presses. It then reports the
+ * per stage latency percentiles and the overall frames per second
+ *
+ * the region of interest follows the largest hand as it does in main, which
+ * keeps to the full frame when more than one hand is looked for
+ *
+ * usage: Benchmark <video or image pattern> <background image> [max frames] [grid|dt|c2f]
+ *                  [max hands]
+ */
+
+int main(int argc, char **argv)
+{
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0]
+                  << " <video or image pattern> <background image> [max frames] [grid|dt|c2f]"
+                  << " [max hands]" << std::endl;
+        return 1;
+    }
+
+    int maxFrames = argc > 3 ? atoi(argv[3]) : -1;
+
+    // the palm engine to benchmark
+    PalmEngine palmEngine = PALM_DISTANCE_TRANSFORM;
+    std::string engine = argc > 4 ? argv[4] : "dt";
+    if (engine == "grid") {
+        palmEngine = PALM_GRID;
+    }
+    else if (engine == "c2f") {
+        palmEngine = PALM_COARSE_TO_FINE;
+    }
+
+    // how many hands to look for, one as in main unless told otherwise
+    int maxHands = argc > 5 ? atoi(argv[5]) : 1;
+
+    Replay replay(argv[1], argv[2]);
+    if (!replay.isOpened()) {
+        std::cerr << "could not open " << argv[1] << " or " << argv[2] << std::endl;
+        return 1;
+    }
+
+    // Setup preprocessor and detector, nothing is drawn so only the geometry is timed
+    Preprocess p(replay.background());
+    Detect d(palmEngine, maxHands);
+    RoiTracker tracker;
+    tracker.setMaxHands(maxHands);
+    const Hand none = Hand();
+
+    LatencyStats preprocessStats;
+    LatencyStats detectStats;
+    LatencyStats frameStats;
+
+    // break the two stages down further
+    setTracing(true);
+
+    Mat frame;
+    int count = 0;
+    int64 start = getTickCount();
+
+    while ((maxFrames < 0 || count < maxFrames) && replay.next(frame)) {
+        int64 frameStart = getTickCount();
+        Mat hand = p(frame);
+        preprocessStats.add(elapsedMs(frameStart));
+
+        int64 detectStart = getTickCount();
+        const vector<Hand>& hands = d.findHands(hand);
+        detectStats.add(elapsedMs(detectStart));
+
+        // the largest hand is the one the region follows
+        const Hand& found = hands.empty() ? none : hands[0];
+        p.setRegionOfInterest(tracker.update(found.palm, found.enclosing, frame.size()));
+
+        frameStats.add(elapsedMs(frameStart));
+        ++count;
+    }
+
+    double seconds = elapsedMs(start) / 1000.0;
+
+    time_t now = time(0);
+    char date[32];
+    strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+    printf("# %s  %s  %d frames  %s  %d hands\n", date, argv[1], count, engine.c_str(), maxHands);
+    printf("%-12s %10s %10s %10s %10s\n", "stage", "p50 (ms)", "p95 (ms)", "p99 (ms)", "mean (ms)");
+    printStage("preprocess", preprocessStats);
+    printStage("detect", detectStats);
+    printStage("frame", frameStats);
+    printf("fps %.2f\n", seconds > 0 ? count / seconds : 0.0);
+    fflush(stdout);
+
+    printTraceSummary(std::cout);
+    std::cout << std::endl;
+
+    return count > 0 ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+#ifndef BOUNDEDQUEUE_H
+#define BOUNDEDQUEUE_H
+
+// ========
+// includes
+// ========
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// what a full queue does with a new item
+enum DropPolicy
+{
+    // wait for the consumer to take an item
+    DROP_NONE,
+
+    // throw away the oldest item waiting, so the newest always gets through
+    DROP_OLDEST
+};
+
+/**
+ * The BoundedQueue class
+ *
+ * A fixed size first in first out queue shared between two threads
+ *
+ * Pushing onto a full queue either waits for room or drops the oldest item,
+ * depending on its policy. Once closed, pushes are refused and pops return
+ * whatever is left before failing. The items live in a ring buffer allocated
+ * up front, so pushing and popping never allocate
+ */
+
+template<typename T>
+class BoundedQueue
+{
+    private:
+        std::vector<T> _items;
+        size_t _head;
+        size_t _size;
+        const DropPolicy _policy;
+        bool _closed;
+
+        std::mutex _mutex;
+        std::condition_variable _notEmpty;
+        std::condition_variable _notFull;
+
+    public:
+        BoundedQueue(size_t capacity, DropPolicy policy = DROP_NONE) :
+            _items(std::max<size_t>(1, capacity)),
+            _head(0),
+            _size(0),
+            _policy(policy),
+            _closed(false)
+        {}
+
+        // adds an item, returns true if one comes back in rejected, which is
+        // the oldest item when it had to be dropped, or the item itself when
+        // the queue is closed
+        bool push(const T& item, T& rejected)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            if (_closed) {
+                rejected = item;
+                return true;
+            }
+
+            bool drop = false;
+            if (_policy == DROP_NONE) {
+                _notFull.wait(lock, [this] { return _closed || _size < _items.size(); });
+                if (_closed) {
+                    rejected = item;
+                    return true;
+                }
+            }
+            else if (_size == _items.size()) {
+                rejected = _items[_head];
+                _head = (_head + 1) % _items.size();
+                --_size;
+                drop = true;
+            }
+
+            _items[(_head + _size) % _items.size()] = item;
+            ++_size;
+            _notEmpty.notify_one();
+            return drop;
+        }
+
+        // takes the oldest item without waiting, false if there is none
+        bool tryPop(T& item)
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            if (_size == 0) {
+                return false;
+            }
+
+            item = _items[_head];
+            _head = (_head + 1) % _items.size();
+            --_size;
+            _notFull.notify_one();
+            return true;
+        }
+
+        // takes the oldest item, waiting for one, false once closed and empty
+        bool pop(T& item)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _notEmpty.wait(lock, [this] { return _closed || _size > 0; });
+            if (_size == 0) {
+                return false;
+            }
+
+            item = _items[_head];
+            _head = (_head + 1) % _items.size();
+            --_size;
+            _notFull.notify_one();
+            return true;
+        }
+
+        // refuses any further pushes and wakes everyone waiting
+        void close()
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _closed = true;
+            _notEmpty.notify_all();
+            _notFull.notify_all();
+        }
+};
+
+#endif // BOUNDEDQUEUE_H
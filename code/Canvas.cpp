@@ -0,0 +1,323 @@
+#include "Canvas.h"
+
+#include <algorithm>
+
+/**
+ * rounds the division down, also for negative numbers
+ */
+
+static int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+/**
+ * The constructor for Canvas
+ *
+ * viewSize is the size of the image render returns, and tileSize the side
+ * of a tile in board pixels. The viewport starts at the board's origin with
+ * no zoom, so an undisturbed canvas behaves like the old whiteboard
+ */
+
+Canvas::Canvas(const Size& viewSize, int tileSize) :
+    _tileSize(std::max(1, tileSize)),
+    _offset(0, 0),
+    _zoom(1),
+    _viewChanged(true),
+    _view(Mat::zeros(viewSize, CV_8U))
+{}
+
+/**
+ * The destructor for Canvas
+ *
+ * As of now this does nothing
+ */
+
+Canvas::~Canvas()
+{}
+
+/**
+ * Packs the tile coordinates into a single key
+ */
+
+long long Canvas::key(int tx, int ty)
+{
+    return (long long)(((unsigned long long)(unsigned int)tx << 32) | (unsigned int)ty);
+}
+
+/**
+ * Returns the board rectangle of the tile with the key given
+ */
+
+Rect Canvas::tileRect(long long key) const
+{
+    int tx = (int)(key >> 32);
+    int ty = (int)(unsigned int)key;
+    return Rect(tx * _tileSize, ty * _tileSize, _tileSize, _tileSize);
+}
+
+/**
+ * Returns where a board rectangle ends up in the view
+ *
+ * Both corners are rounded the same way, so neighbouring tiles meet exactly
+ * at any zoom
+ */
+
+Rect Canvas::toView(const Rect& board) const
+{
+    int x0 = cvRound((board.x - _offset.x) * _zoom);
+    int y0 = cvRound((board.y - _offset.y) * _zoom);
+    int x1 = cvRound((board.x + board.width - _offset.x) * _zoom);
+    int y1 = cvRound((board.y + board.height - _offset.y) * _zoom);
+    return Rect(x0, y0, x1 - x0, y1 - y0);
+}
+
+/**
+ * Marks a tile to be copied into the view on the next render
+ */
+
+void Canvas::touch(long long key, Tile& tile)
+{
+    if (!tile.dirty) {
+        tile.dirty = true;
+        _dirty.push_back(key);
+    }
+}
+
+/**
+ * Sets the pixels of the board box where _stroke is non zero to the value
+ * given, 255 to draw and 0 to erase
+ *
+ * The shape is drawn whole into _stroke first and only then split over the
+ * tiles, since OpenCV clips thick lines slightly differently at every image
+ * edge, and a line drawn tile by tile would not quite match one drawn whole.
+ * Drawing allocates the tiles it needs, erasing frees the ones it empties
+ */
+
+void Canvas::stamp(const Rect& box, uchar value)
+{
+    int tx0 = floorDiv(box.x, _tileSize);
+    int ty0 = floorDiv(box.y, _tileSize);
+    int tx1 = floorDiv(box.x + box.width - 1, _tileSize);
+    int ty1 = floorDiv(box.y + box.height - 1, _tileSize);
+
+    for (int ty = ty0; ty <= ty1; ++ty) {
+        for (int tx = tx0; tx <= tx1; ++tx) {
+            Rect tr(tx * _tileSize, ty * _tileSize, _tileSize, _tileSize);
+            Rect r = tr & box;
+            Mat mask = _stroke(r - box.tl());
+
+            // the corners of a diagonal stroke's box are usually empty
+            if (countNonZero(mask) == 0) {
+                continue;
+            }
+
+            long long k = key(tx, ty);
+            std::unordered_map<long long, Tile>::iterator it = _tiles.find(k);
+
+            if (it == _tiles.end()) {
+                // nothing to erase on a tile that was never drawn on
+                if (value == 0) {
+                    continue;
+                }
+
+                Tile tile;
+                tile.ink = Mat::zeros(_tileSize, _tileSize, CV_8U);
+                tile.dirty = false;
+                it = _tiles.insert(std::make_pair(k, tile)).first;
+            }
+
+            Tile& tile = it->second;
+            tile.ink(r - tr.tl()).setTo(Scalar(value), mask);
+
+            // free a tile once it is erased completely
+            if (value == 0 && countNonZero(tile.ink) == 0) {
+                if (!tile.dirty) {
+                    _dirty.push_back(k);
+                }
+                _tiles.erase(it);
+                continue;
+            }
+
+            touch(k, tile);
+        }
+    }
+}
+
+/**
+ * Draws a line between two board points, as the whiteboard used to
+ */
+
+void Canvas::line(const Point& from, const Point& to, int thickness)
+{
+    int pad = thickness / 2 + 2;
+    Rect box(Point(std::min(from.x, to.x) - pad, std::min(from.y, to.y) - pad),
+             Point(std::max(from.x, to.x) + pad + 1, std::max(from.y, to.y) + pad + 1));
+
+    _stroke.create(box.size(), CV_8U);
+    _stroke.setTo(Scalar::all(0));
+    cv::line(_stroke, from - box.tl(), to - box.tl(), Scalar(255), thickness);
+
+    stamp(box, 255);
+}
+
+/**
+ * Erases a filled disk around a board point
+ */
+
+void Canvas::erase(const Point& center, int radius)
+{
+    radius = std::max(0, radius);
+    Rect box(center.x - radius - 1, center.y - radius - 1, 2 * radius + 3, 2 * radius + 3);
+
+    _stroke.create(box.size(), CV_8U);
+    _stroke.setTo(Scalar::all(0));
+    circle(_stroke, center - box.tl(), radius, Scalar(255), -1);
+
+    stamp(box, 0);
+}
+
+/**
+ * Wipes the board, freeing every tile
+ */
+
+void Canvas::clear()
+{
+    _tiles.clear();
+    _dirty.clear();
+    _viewChanged = true;
+}
+
+/**
+ * Moves the viewport
+ *
+ * offset is the board point shown at the top left of the view, and zoom how
+ * many view pixels a board pixel covers. The whole view is redrawn on the
+ * next render
+ */
+
+void Canvas::setViewport(const Point2f& offset, double zoom)
+{
+    _offset = offset;
+    _zoom = std::max(zoom, 1e-3);
+    _viewChanged = true;
+}
+
+/**
+ * Moves the viewport by a number of view pixels
+ */
+
+void Canvas::pan(const Point2f& delta)
+{
+    setViewport(_offset + delta * (float)(1.0 / _zoom), _zoom);
+}
+
+/**
+ * Zooms in (factor above 1) or out, keeping the board point under the view
+ * point anchor where it is
+ */
+
+void Canvas::zoom(double factor, const Point& anchor)
+{
+    double zoom = std::max(_zoom * factor, 1e-3);
+    Point2f board(_offset.x + anchor.x / _zoom, _offset.y + anchor.y / _zoom);
+    setViewport(Point2f(board.x - anchor.x / zoom, board.y - anchor.y / zoom), zoom);
+}
+
+/**
+ * Returns the board point under a view point
+ */
+
+Point Canvas::toBoard(const Point& view) const
+{
+    return Point(cvFloor(_offset.x + view.x / _zoom), cvFloor(_offset.y + view.y / _zoom));
+}
+
+/**
+ * Returns the length in board pixels of a length in view pixels
+ */
+
+double Canvas::toBoard(double length) const
+{
+    return length / _zoom;
+}
+
+/**
+ * Copies one tile into the view, scaled to the zoom, or clears its place in
+ * the view if the tile has been freed
+ */
+
+void Canvas::composite(long long key)
+{
+    std::unordered_map<long long, Tile>::iterator it = _tiles.find(key);
+    if (it != _tiles.end()) {
+        it->second.dirty = false;
+    }
+
+    Rect target = toView(tileRect(key));
+    Rect visible = target & Rect(0, 0, _view.cols, _view.rows);
+    if (visible.area() <= 0) {
+        return;
+    }
+
+    if (it == _tiles.end()) {
+        _view(visible).setTo(Scalar::all(0));
+        return;
+    }
+
+    const Mat& ink = it->second.ink;
+
+    if (target.size() == ink.size()) {
+        ink(visible - target.tl()).copyTo(_view(visible));
+    }
+    else {
+        resize(ink, _scaled, target.size(), 0, 0, _zoom > 1 ? INTER_NEAREST : INTER_AREA);
+        _scaled(visible - target.tl()).copyTo(_view(visible));
+    }
+}
+
+/**
+ * Brings the view up to date and returns it
+ *
+ * Only the dirty tiles are copied, unless the viewport moved since the last
+ * render, in which case the view is cleared and every tile is copied. The
+ * view belongs to the canvas and changes on the next render
+ */
+
+const Mat& Canvas::render()
+{
+    if (_viewChanged) {
+        _view.setTo(Scalar::all(0));
+        for (std::unordered_map<long long, Tile>::iterator it = _tiles.begin(); it != _tiles.end(); ++it) {
+            composite(it->first);
+        }
+        _viewChanged = false;
+    }
+    else {
+        for (size_t i = 0; i < _dirty.size(); ++i) {
+            composite(_dirty[i]);
+        }
+    }
+
+    _dirty.clear();
+    return _view;
+}
+
+/**
+ * Returns the number of tiles allocated, which is what the board costs in
+ * memory
+ */
+
+size_t Canvas::tiles() const
+{
+    return _tiles.size();
+}
+
+/**
+ * Returns the number of tiles the next render will copy
+ */
+
+size_t Canvas::dirtyTiles() const
+{
+    return _dirty.size();
+}
@@ -0,0 +1,114 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv/cv.h>
+
+#include <unordered_map>
+#include <vector>
+
+/**
+ * The Canvas class
+ *
+ * This is the whiteboard the hand draws on
+ *
+ * The board has no edges. It is cut into square 8 bit tiles, and a tile only
+ * exists once something has been drawn on it, so the memory used grows with
+ * the ink rather than with the area of the board. Tiles that are erased
+ * completely are freed again
+ *
+ * What is shown is a viewport onto the board, which can be panned and
+ * zoomed. Every tile touched since the last render is marked dirty, and
+ * render only copies the dirty tiles into the view, so the cost of a frame
+ * follows what changed in it. Moving the viewport redraws the whole view
+ */
+
+using namespace cv;
+
+class Canvas
+{
+    private:
+        // a tile, and whether it changed since the last render
+        struct Tile
+        {
+            Mat ink;
+            bool dirty;
+        };
+
+        const int _tileSize;
+        std::unordered_map<long long, Tile> _tiles;
+
+        // the tiles changed since the last render, including freed ones
+        std::vector<long long> _dirty;
+
+        // the board point at the top left of the view, and the view pixels per board pixel
+        Point2f _offset;
+        double _zoom;
+        bool _viewChanged;
+
+        // the view, and the scratch buffers for a stroke and a zoomed tile
+        Mat _view;
+        Mat _stroke;
+        Mat _scaled;
+
+        // the key of the tile at the tile coordinates given
+        static long long key(int tx, int ty);
+
+        // the board rectangle covered by the tile with the key given
+        Rect tileRect(long long key) const;
+
+        // the view rectangle the board rectangle given ends up in
+        Rect toView(const Rect& board) const;
+
+        // marks a tile as changed
+        void touch(long long key, Tile& tile);
+
+        // sets the pixels of the box where _stroke is non zero to the value given
+        void stamp(const Rect& box, uchar value);
+
+        // copies one tile, or black if it is gone, into the view
+        void composite(long long key);
+
+    public:
+        Canvas(const Size& viewSize, int tileSize = 64);
+        ~Canvas();
+
+        // draws a line between two board points
+        void line(const Point& from, const Point& to, int thickness = 3);
+
+        // erases a disk around a board point
+        void erase(const Point& center, int radius);
+
+        // wipes the whole board
+        void clear();
+
+        // moves the viewport, in board pixels, and sets its zoom
+        void setViewport(const Point2f& offset, double zoom);
+
+        // moves the viewport by a number of view pixels
+        void pan(const Point2f& delta);
+
+        // zooms by a factor, keeping the view point given in place
+        void zoom(double factor, const Point& anchor);
+
+        // the board point under a view point
+        Point toBoard(const Point& view) const;
+
+        // the length in board pixels of a length in view pixels
+        double toBoard(double length) const;
+
+        // copies what changed into the view and returns it, 8 bit
+        const Mat& render();
+
+        // the number of tiles allocated
+        size_t tiles() const;
+
+        // the number of tiles waiting to be copied into the view
+        size_t dirtyTiles() const;
+};
+
+#endif // CANVAS_H
@@ -0,0 +1,278 @@
+#include "Config.h"
+
+#include <vector>
+
+// the height the detect settings are given for
+static const double REFERENCE_HEIGHT = 480;
+
+// the names of the palm engines in a config file, the same as the Benchmark takes
+static const char* palmEngineNames[] = { "grid", "dt", "c2f" };
+
+/**
+ * reads an int setting, leaving the value alone if the file has none
+ */
+
+static void readSetting(const FileNode& node, int& value)
+{
+    if (!node.empty()) {
+        value = (int)node;
+    }
+}
+
+/**
+ * reads a real setting, leaving the value alone if the file has none
+ */
+
+static void readSetting(const FileNode& node, double& value)
+{
+    if (!node.empty()) {
+        value = (double)node;
+    }
+}
+
+/**
+ * reads a list of up to four reals into a Scalar, leaving the channels the
+ * list does not reach alone
+ */
+
+static void readSetting(const FileNode& node, Scalar& value)
+{
+    if (!node.empty()) {
+        std::vector<double> channels;
+        node >> channels;
+        for (size_t i = 0; i < channels.size() && i < 4; ++i) {
+            value[i] = channels[i];
+        }
+    }
+}
+
+/**
+ * the first three channels of a Scalar, for writing a YCrCb triple
+ */
+
+static std::vector<double> channels(const Scalar& value)
+{
+    return std::vector<double>(&value[0], &value[0] + 3);
+}
+
+/**
+ * The constructor for DrawConfig
+ *
+ * The constants HandMade always used, at 640x480
+ */
+
+DrawConfig::DrawConfig() :
+    tipMaxDistance(60),
+    tipDedupeRadius(10),
+    strokeBreak(200)
+{}
+
+/**
+ * The constructor for Config
+ *
+ * The defaults are the constants the pipeline always used, at 640x480
+ */
+
+Config::Config() :
+    profile("default"),
+    frameSize(640, 480),
+    pyramidLevel(0),
+    palmEngine(PALM_DISTANCE_TRANSFORM),
+    maxHands(1)
+{}
+
+/**
+ * Replaces the settings with a preset
+ *
+ *   default      the constants the pipeline always used
+ *   low-latency  a single hand at half resolution, with the coarse to fine
+ *                palm search, for the least time from camera to board
+ *   accurate     a closer approxPolyDP at full resolution, so the hull and the
+ *                defects follow the mask more tightly. The palm is already
+ *                exact with the distance transform engine
+ *   1080p        a 1920x1080 capture processed at a quarter of it, 480x270,
+ *                so it costs about what a 640x480 frame does
+ *
+ * Every preset starts from the defaults, so applying one undoes whatever
+ * was set before it
+ */
+
+bool applyPreset(const std::string& name, Config& config)
+{
+    Config preset;
+    preset.profile = name;
+
+    if (name == "low-latency") {
+        preset.pyramidLevel = 1;
+        preset.palmEngine = PALM_COARSE_TO_FINE;
+    }
+    else if (name == "accurate") {
+        preset.detect.polyEpsilon = 1.0;
+    }
+    else if (name == "1080p") {
+        preset.frameSize = Size(1920, 1080);
+        preset.pyramidLevel = 2;
+    }
+    else if (name != "default") {
+        return false;
+    }
+
+    config = preset;
+    return true;
+}
+
+/**
+ * Reads a config file over the settings
+ *
+ * The file is anything FileStorage reads, YAML or XML. If it names a
+ * profile, that preset is applied first, and every other setting in it then
+ * overrides the preset. Settings the file leaves out keep their value, so a
+ * file only needs to hold what it changes. An unknown profile or palm engine
+ * fails the whole file, leaving the settings as they were
+ */
+
+bool loadConfig(const std::string& path, Config& config)
+{
+    FileStorage fs(path, FileStorage::READ);
+    if (!fs.isOpened()) {
+        return false;
+    }
+
+    Config loaded = config;
+    std::string profile = (std::string)fs["profile"];
+    if (!profile.empty() && !applyPreset(profile, loaded)) {
+        return false;
+    }
+
+    readSetting(fs["frameWidth"], loaded.frameSize.width);
+    readSetting(fs["frameHeight"], loaded.frameSize.height);
+    readSetting(fs["pyramidLevel"], loaded.pyramidLevel);
+    readSetting(fs["maxHands"], loaded.maxHands);
+
+    std::string engine = (std::string)fs["palmEngine"];
+    if (!engine.empty()) {
+        int found = -1;
+        for (int i = PALM_GRID; i <= PALM_COARSE_TO_FINE; ++i) {
+            if (engine == palmEngineNames[i]) {
+                found = i;
+            }
+        }
+        if (found < 0) {
+            return false;
+        }
+        loaded.palmEngine = (PalmEngine)found;
+    }
+
+    FileNode preprocess = fs["preprocess"];
+    readSetting(preprocess["minYCrCb"], loaded.preprocess.minYCrCb);
+    readSetting(preprocess["maxYCrCb"], loaded.preprocess.maxYCrCb);
+    readSetting(preprocess["blurSize"], loaded.preprocess.blurSize);
+    readSetting(preprocess["blurSigma"], loaded.preprocess.blurSigma);
+    readSetting(preprocess["openIterations"], loaded.preprocess.openIterations);
+    readSetting(preprocess["channelThresholds"], loaded.preprocess.channelThresholds);
+
+    FileNode detect = fs["detect"];
+    readSetting(detect["minContourArea"], loaded.detect.minContourArea);
+    readSetting(detect["polyEpsilon"], loaded.detect.polyEpsilon);
+    readSetting(detect["gridStep"], loaded.detect.gridStep);
+    readSetting(detect["regionRadii"], loaded.detect.regionRadii);
+    readSetting(detect["minDefectDepth"], loaded.detect.minDefectDepth);
+    readSetting(detect["tipPairing"], loaded.detect.tipPairing);
+
+    FileNode draw = fs["draw"];
+    readSetting(draw["tipMaxDistance"], loaded.draw.tipMaxDistance);
+    readSetting(draw["tipDedupeRadius"], loaded.draw.tipDedupeRadius);
+    readSetting(draw["strokeBreak"], loaded.draw.strokeBreak);
+
+    config = loaded;
+    return true;
+}
+
+/**
+ * Writes every setting to a config file
+ *
+ * The file reads back into the same settings, and makes a starting point to
+ * tune a deployment from
+ */
+
+bool saveConfig(const std::string& path, const Config& config)
+{
+    FileStorage fs(path, FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        return false;
+    }
+
+    fs << "profile" << config.profile;
+    fs << "frameWidth" << config.frameSize.width;
+    fs << "frameHeight" << config.frameSize.height;
+    fs << "pyramidLevel" << config.pyramidLevel;
+    fs << "palmEngine" << std::string(palmEngineNames[config.palmEngine]);
+    fs << "maxHands" << config.maxHands;
+
+    const PreprocessConfig& preprocess = config.preprocess;
+    fs << "preprocess" << "{"
+       << "minYCrCb" << channels(preprocess.minYCrCb)
+       << "maxYCrCb" << channels(preprocess.maxYCrCb)
+       << "blurSize" << preprocess.blurSize
+       << "blurSigma" << preprocess.blurSigma
+       << "openIterations" << preprocess.openIterations
+       << "channelThresholds" << channels(preprocess.channelThresholds)
+       << "}";
+
+    const DetectConfig& detect = config.detect;
+    fs << "detect" << "{"
+       << "minContourArea" << detect.minContourArea
+       << "polyEpsilon" << detect.polyEpsilon
+       << "gridStep" << detect.gridStep
+       << "regionRadii" << detect.regionRadii
+       << "minDefectDepth" << detect.minDefectDepth
+       << "tipPairing" << detect.tipPairing
+       << "}";
+
+    const DrawConfig& draw = config.draw;
+    fs << "draw" << "{"
+       << "tipMaxDistance" << draw.tipMaxDistance
+       << "tipDedupeRadius" << draw.tipDedupeRadius
+       << "strokeBreak" << draw.strokeBreak
+       << "}";
+
+    return true;
+}
+
+/**
+ * Scales the detect settings, given for a 480 line frame, to frames of the
+ * size given
+ *
+ * The lengths grow with the height of the frame and the area with its
+ * square. The ratios of the palm radius are the same at any size
+ */
+
+DetectConfig scaleDetectConfig(const DetectConfig& detect, const Size& frameSize)
+{
+    double scale = frameSize.height / REFERENCE_HEIGHT;
+
+    DetectConfig scaled = detect;
+    scaled.minContourArea = detect.minContourArea * scale * scale;
+    scaled.polyEpsilon = detect.polyEpsilon * scale;
+    scaled.gridStep = std::max(1, cvRound(detect.gridStep * scale));
+    scaled.minDefectDepth = detect.minDefectDepth * scale;
+    return scaled;
+}
+
+/**
+ * Scales the draw settings, given for a 480 line frame, to frames of the
+ * size given
+ *
+ * They are all lengths, so they grow with the height of the frame
+ */
+
+DrawConfig scaleDrawConfig(const DrawConfig& draw, const Size& frameSize)
+{
+    double scale = frameSize.height / REFERENCE_HEIGHT;
+
+    DrawConfig scaled = draw;
+    scaled.tipMaxDistance = draw.tipMaxDistance * scale;
+    scaled.tipDedupeRadius = draw.tipDedupeRadius * scale;
+    scaled.strokeBreak = draw.strokeBreak * scale;
+    return scaled;
+}
@@ -0,0 +1,93 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+
+#include "Detect.h"
+#include "Preprocess.h"
+
+using namespace cv;
+
+/**
+ * How HandMade follows the finger tips and draws with them
+ *
+ * Every length is in pixels of a 480 line frame, like those of DetectConfig.
+ * The defaults are the constants HandMade always used
+ */
+
+struct DrawConfig
+{
+    // how far a finger tip can move from one frame to the next and still be the same finger
+    double tipMaxDistance;
+
+    // finger tips closer together than this are the same finger
+    double tipDedupeRadius;
+
+    // a tip that jumps farther than this from one frame to the next starts a new stroke
+    double strokeBreak;
+
+    DrawConfig();
+};
+
+/**
+ * Everything a deployment tunes, in one place
+ *
+ * The capture size, the pyramid level the hand is processed at, how the
+ * palm is found and how many hands are looked for, and the settings of
+ * Preprocess and Detect. A Config starts out with the constants the
+ * pipeline always used, a preset replaces them with a profile tuned for a
+ * purpose, and a file read with loadConfig overrides whatever it names
+ *
+ * The lengths and areas of detect and draw are meant for a 480 line frame,
+ * which is what the defaults were tuned on. scaleDetectConfig and
+ * scaleDrawConfig scale them to the frame size actually used, so the same
+ * file works at 720p or 1080p. The blur and
+ * the open of preprocess are about the noise of single pixels, so they stay
+ * as they are at any size
+ */
+
+struct Config
+{
+    // the preset the settings started from
+    std::string profile;
+
+    // the size the camera is asked for
+    Size frameSize;
+
+    // the pyramid level the hand is segmented and analysed at, 0 to 2
+    int pyramidLevel;
+
+    // how the palm is found, and the most hands looked for
+    PalmEngine palmEngine;
+    int maxHands;
+
+    PreprocessConfig preprocess;
+    DetectConfig detect;
+    DrawConfig draw;
+
+    Config();
+};
+
+// replaces the settings with the preset named, "default", "low-latency",
+// "accurate" or "1080p", false (changing nothing) for any other name
+bool applyPreset(const std::string& name, Config& config);
+
+// reads a config file over the settings, false if it could not be read
+bool loadConfig(const std::string& path, Config& config);
+
+// writes every setting to a config file, false if it could not be written
+bool saveConfig(const std::string& path, const Config& config);
+
+// the detect settings, given for a 480 line frame, for frames of the size given
+DetectConfig scaleDetectConfig(const DetectConfig& detect, const Size& frameSize);
+
+// the draw settings, given for a 480 line frame, for frames of the size given
+DrawConfig scaleDrawConfig(const DrawConfig& draw, const Size& frameSize);
+
+#endif // CONFIG_H
@@ -0,0 +1,409 @@
+#include "Corpus.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <sstream>
+
+#include "Detect.h"
+#include "Preprocess.h"
+
+/**
+ * runs a chunk of the frames of a corpus
+ *
+ * Each chunk has a Preprocess and a Detect of its own, so the chunks share
+ * nothing but the background, which is only read
+ */
+
+class CorpusRunner : public ParallelLoopBody
+{
+    private:
+        const std::string& _dir;
+        const Mat& _background;
+        const std::vector<GoldenFrame>& _frames;
+        std::vector<GoldenFrame>& _results;
+        const Config& _config;
+
+    public:
+        CorpusRunner(const std::string& dir, const Mat& background,
+                     const std::vector<GoldenFrame>& frames, std::vector<GoldenFrame>& results,
+                     const Config& config) :
+            _dir(dir),
+            _background(background),
+            _frames(frames),
+            _results(results),
+            _config(config)
+        {}
+
+        void operator()(const Range& range) const
+        {
+            // no cascade, so no faces are blacked out and nothing depends on timing
+            Preprocess p(_background, "", _config.preprocess);
+            Detect d(_config.palmEngine, 1, scaleDetectConfig(_config.detect, _background.size()));
+            p.setPyramidLevel(_config.pyramidLevel);
+            d.setPyramidLevel(p.pyramidLevel());
+            Mat contours;
+
+            for (int i = range.start; i < range.end; ++i) {
+                GoldenFrame& result = _results[i];
+                result = GoldenFrame();
+                result.file = _frames[i].file;
+
+                Mat frame = imread(_dir + "/" + result.file);
+                if (frame.empty() || frame.size() != _background.size()) {
+                    continue;
+                }
+
+                const Mat& mask = p(frame);
+                result.read = true;
+                result.maskHash = maskHash(mask);
+                result.maskArea = countNonZero(mask > 127) << (2 * p.pyramidLevel());
+
+                // finding the contours eats the mask
+                mask.copyTo(contours);
+                const vector<Hand>& hands = d.findHands(contours);
+                if (!hands.empty()) {
+                    Hand hand = hands[0];
+                    d.toFullResolution(hand, mask);
+
+                    result.palm = hand.palm.first;
+                    result.radius = hand.palm.second;
+                    result.tips = hand.tips;
+                }
+            }
+        }
+};
+
+/**
+ * The constructor for GoldenFrame
+ *
+ * An unread frame without a hand
+ */
+
+GoldenFrame::GoldenFrame() :
+    read(false),
+    maskHash(0),
+    maskArea(0),
+    palm(0, 0),
+    radius(0)
+{}
+
+/**
+ * The constructor for GoldenTolerance
+ *
+ * The defaults let a palm or a tip move by a couple of pixels and the mask
+ * area change by half a percent, which rounding differences in the blurs
+ * stay well inside of. Masks only have to be the same to the bit with
+ * exactMask, for changes that claim to give exactly the same output
+ */
+
+GoldenTolerance::GoldenTolerance() :
+    palm(2),
+    radius(1),
+    tip(3),
+    maskArea(0.005),
+    exactMask(false)
+{}
+
+/**
+ * Returns a 64 bit FNV-1a hash of the pixels of a mask, row by row, so a
+ * mask that is a view into a larger image hashes the same as a copy of it
+ */
+
+uint64 maskHash(const Mat& mask)
+{
+    uint64 hash = 14695981039346656037ULL;
+    size_t width = mask.cols * mask.elemSize();
+
+    for (int y = 0; y < mask.rows; ++y) {
+        const uchar* row = mask.ptr(y);
+        for (size_t x = 0; x < width; ++x) {
+            hash = (hash ^ row[x]) * 1099511628211ULL;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Compares a frame with its reference
+ *
+ * Returns an empty string if the frame is within the tolerance given, and
+ * otherwise everything about it that is not, separated by commas. The tips
+ * are matched greedily, each reference tip to the nearest current tip no
+ * other reference tip took
+ */
+
+std::string compareGolden(const GoldenFrame& expected, const GoldenFrame& actual,
+                          const GoldenTolerance& tolerance)
+{
+    if (!actual.read) {
+        return "could not be read";
+    }
+
+    std::vector<std::string> reasons;
+    std::ostringstream reason;
+
+    if (tolerance.exactMask && expected.maskHash != actual.maskHash) {
+        reasons.push_back("mask changed");
+    }
+
+    double areaChange = std::abs(actual.maskArea - expected.maskArea);
+    if (areaChange > tolerance.maskArea * std::max(1, expected.maskArea)) {
+        reason << "mask area " << expected.maskArea << " -> " << actual.maskArea;
+        reasons.push_back(reason.str());
+    }
+
+    bool hadHand = expected.radius > 0;
+    bool hasHand = actual.radius > 0;
+
+    if (hadHand != hasHand) {
+        reasons.push_back(hadHand ? "hand lost" : "hand found where there was none");
+    }
+    else if (hadHand) {
+        double moved = norm(actual.palm - expected.palm);
+        if (moved > tolerance.palm) {
+            reason.str("");
+            reason << "palm moved " << moved << " px";
+            reasons.push_back(reason.str());
+        }
+
+        if (std::abs(actual.radius - expected.radius) > tolerance.radius) {
+            reason.str("");
+            reason << "palm radius " << expected.radius << " -> " << actual.radius;
+            reasons.push_back(reason.str());
+        }
+
+        if (actual.tips.size() != expected.tips.size()) {
+            reason.str("");
+            reason << expected.tips.size() << " tips -> " << actual.tips.size();
+            reasons.push_back(reason.str());
+        }
+        else {
+            std::vector<bool> taken(actual.tips.size(), false);
+            for (size_t i = 0; i < expected.tips.size(); ++i) {
+                int nearest = -1;
+                double best = 0;
+                for (size_t j = 0; j < actual.tips.size(); ++j) {
+                    double distance = norm(actual.tips[j] - expected.tips[i]);
+                    if (!taken[j] && (nearest < 0 || distance < best)) {
+                        nearest = (int)j;
+                        best = distance;
+                    }
+                }
+
+                taken[nearest] = true;
+                if (best > tolerance.tip) {
+                    reason.str("");
+                    reason << "tip " << expected.tips[i] << " moved " << best << " px";
+                    reasons.push_back(reason.str());
+                }
+            }
+        }
+    }
+
+    std::string joined;
+    for (size_t i = 0; i < reasons.size(); ++i) {
+        joined += (i > 0 ? ", " : "") + reasons[i];
+    }
+    return joined;
+}
+
+/**
+ * The constructor for Corpus
+ *
+ * Nothing is read until load, the background defaults to background.png
+ */
+
+Corpus::Corpus(const std::string& dir) :
+    _dir(dir),
+    _background("background.png")
+{}
+
+/**
+ * The destructor for Corpus
+ *
+ * As of now this does nothing
+ */
+
+Corpus::~Corpus()
+{}
+
+/**
+ * Returns the path of a file of the corpus
+ */
+
+std::string Corpus::path(const std::string& file) const
+{
+    return _dir + "/" + file;
+}
+
+/**
+ * Reads the reference from golden.yml
+ *
+ * The hash is kept as a hex string, since FileStorage has no 64 bit
+ * integers, and the tips as a flat list of coordinates
+ */
+
+bool Corpus::load()
+{
+    FileStorage fs(path("golden.yml"), FileStorage::READ);
+    if (!fs.isOpened()) {
+        return false;
+    }
+
+    _background = (std::string)fs["background"];
+    _frames.clear();
+
+    FileNode frames = fs["frames"];
+    for (FileNodeIterator it = frames.begin(); it != frames.end(); ++it) {
+        FileNode node = *it;
+        GoldenFrame frame;
+
+        frame.file = (std::string)node["file"];
+        frame.read = (int)node["read"] != 0;
+        frame.maskHash = strtoull(((std::string)node["maskHash"]).c_str(), 0, 16);
+        frame.maskArea = (int)node["maskArea"];
+        frame.palm = Point((int)node["palmX"], (int)node["palmY"]);
+        frame.radius = (double)node["radius"];
+
+        std::vector<int> tips;
+        node["tips"] >> tips;
+        for (size_t i = 0; i + 1 < tips.size(); i += 2) {
+            frame.tips.push_back(Point(tips[i], tips[i + 1]));
+        }
+
+        _frames.push_back(frame);
+    }
+
+    return !_frames.empty();
+}
+
+/**
+ * Writes the reference to golden.yml
+ */
+
+bool Corpus::save() const
+{
+    FileStorage fs(path("golden.yml"), FileStorage::WRITE);
+    if (!fs.isOpened()) {
+        return false;
+    }
+
+    fs << "background" << _background;
+    fs << "frames" << "[";
+
+    for (size_t i = 0; i < _frames.size(); ++i) {
+        const GoldenFrame& frame = _frames[i];
+
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)frame.maskHash);
+
+        std::vector<int> tips;
+        for (size_t j = 0; j < frame.tips.size(); ++j) {
+            tips.push_back(frame.tips[j].x);
+            tips.push_back(frame.tips[j].y);
+        }
+
+        fs << "{" << "file" << frame.file
+                  << "read" << (int)frame.read
+                  << "maskHash" << std::string(hash)
+                  << "maskArea" << frame.maskArea
+                  << "palmX" << frame.palm.x
+                  << "palmY" << frame.palm.y
+                  << "radius" << frame.radius
+                  << "tips" << tips
+           << "}";
+    }
+
+    fs << "]";
+    return true;
+}
+
+/**
+ * Sets the background image, relative to the directory
+ */
+
+void Corpus::setBackground(const std::string& file)
+{
+    _background = file;
+}
+
+/**
+ * Adds the frames a printf pattern such as "frames/frame_%04d.jpg" numbers,
+ * from zero until the first one that is missing
+ */
+
+int Corpus::addFrames(const std::string& pattern)
+{
+    int added = 0;
+    char file[1024];
+
+    for (;; ++added) {
+        snprintf(file, sizeof(file), pattern.c_str(), added);
+
+        FILE* f = fopen(path(file).c_str(), "rb");
+        if (!f) {
+            break;
+        }
+        fclose(f);
+
+        GoldenFrame frame;
+        frame.file = file;
+        _frames.push_back(frame);
+    }
+    return added;
+}
+
+/**
+ * Returns the frames of the corpus
+ */
+
+const std::vector<GoldenFrame>& Corpus::frames() const
+{
+    return _frames;
+}
+
+/**
+ * Replaces the reference, to record a corpus or accept a change
+ */
+
+void Corpus::setFrames(const std::vector<GoldenFrame>& frames)
+{
+    _frames = frames;
+}
+
+/**
+ * Runs later frames with other settings, to see how far a preset or a
+ * pyramid level strays from the reference. The hashes of the masks never
+ * match at another level, but their areas and the hands are compared in full
+ * resolution pixels. The detect settings are scaled to the background, the
+ * frame size of the config is not used
+ */
+
+void Corpus::setConfig(const Config& config)
+{
+    _config = config;
+}
+
+/**
+ * Runs the pipeline over every frame of the corpus
+ *
+ * The results come back in the order of the frames, whatever order the
+ * chunks ran in. A frame that cannot be read, or is not the size of the
+ * background, comes back unread
+ */
+
+bool Corpus::run(std::vector<GoldenFrame>& results) const
+{
+    Mat background = imread(path(_background));
+    if (background.empty()) {
+        return false;
+    }
+
+    results.resize(_frames.size());
+    parallel_for_(Range(0, (int)_frames.size()), CorpusRunner(_dir, background, _frames, results, _config),
+                  std::max(1, getNumThreads()));
+    return true;
+}
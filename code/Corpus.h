@@ -0,0 +1,123 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+
+#include "Config.h"
+
+using namespace cv;
+
+// what the pipeline made of one frame of a corpus
+struct GoldenFrame
+{
+    // the frame, relative to the corpus directory
+    std::string file;
+
+    // false if the frame could not be read
+    bool read;
+
+    // a hash of the hand mask Preprocess gave, and how many of its pixels are
+    // on, counted in full resolution pixels whatever level the mask is at
+    uint64 maskHash;
+    int maskArea;
+
+    // the palm of the largest hand, with a zero radius when there is none, and its finger tips
+    Point palm;
+    double radius;
+    vector<Point> tips;
+
+    GoldenFrame();
+};
+
+// how far a run may stray from the reference before a frame is reported
+struct GoldenTolerance
+{
+    // in pixels, for the palm center, the palm radius and each finger tip
+    double palm;
+    double radius;
+    double tip;
+
+    // the change in mask area, as a fraction of the reference area
+    double maskArea;
+
+    // whether the mask has to be the same to the bit
+    bool exactMask;
+
+    GoldenTolerance();
+};
+
+// a 64 bit FNV-1a hash of the pixels of a mask
+uint64 maskHash(const Mat& mask);
+
+// compares a frame with its reference, returning what differs or an empty string
+std::string compareGolden(const GoldenFrame& expected, const GoldenFrame& actual,
+                          const GoldenTolerance& tolerance);
+
+/**
+ * The Corpus class
+ *
+ * A directory of recorded frames, a background to preprocess them against,
+ * and golden.yml, which holds the reference output of every frame: a hash
+ * and the area of the hand mask, the palm circle and the finger tips. Any
+ * change to the pipeline can then be run over the corpus and every frame
+ * compared with its reference, so an optimization that is meant to change
+ * nothing can be shown to change nothing
+ *
+ * Every frame is preprocessed over the whole image, without a region of
+ * interest or face detection, so its output depends on nothing but the frame
+ * and the background. That makes the frames independent, and run splits them
+ * into one chunk per thread, each with a Preprocess and Detect of its own
+ */
+
+class Corpus
+{
+    private:
+        // the directory, and the background and the frames in it
+        std::string _dir;
+        std::string _background;
+        std::vector<GoldenFrame> _frames;
+
+        // the settings the frames are run with
+        Config _config;
+
+        // the path of a file of the corpus
+        std::string path(const std::string& file) const;
+
+    public:
+        Corpus(const std::string& dir);
+        ~Corpus();
+
+        // reads golden.yml, false if it is missing or has no frames
+        bool load();
+
+        // writes golden.yml
+        bool save() const;
+
+        // the background image, relative to the directory
+        void setBackground(const std::string& file);
+
+        // adds the frames a printf pattern numbers from zero, until one is missing,
+        // returning how many were added
+        int addFrames(const std::string& pattern);
+
+        // the reference frames, or the frames to record if nothing is recorded yet
+        const std::vector<GoldenFrame>& frames() const;
+
+        // replaces the reference with the results of a run
+        void setFrames(const std::vector<GoldenFrame>& frames);
+
+        // the settings to run the frames with, a reference is meant to be recorded with the defaults
+        void setConfig(const Config& config);
+
+        // runs the pipeline over every frame, in parallel, false if there is no background
+        bool run(std::vector<GoldenFrame>& results) const;
+};
+
+#endif // CORPUS_H
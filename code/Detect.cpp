@@ -1,27 +1,98 @@
 #include "Detect.h"
+#include "Trace.h"
+#include <algorithm>
 #include <iostream>
 #include <math.h>
 
-// global bool to makeMovies;
-bool makeMoviesD = FALSE;
+/**
+ * the milliseconds gone by since the tick count given
+ */
+
+static double msSince(int64 start)
+{
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
+
+/**
+ * packs the coordinates of a grid cell into a single key
+ */
+
+static long long cellKey(int cx, int cy)
+{
+    return (long long)(((unsigned long long)(unsigned int)cx << 32) | (unsigned int)cy);
+}
+
+/**
+ * finds the hands of a range of ranked curves, each with its own detector
+ */
+
+class HandFinder : public ParallelLoopBody
+{
+    private:
+        const vector<Detect*>& _detectors;
+        const vector<vector<vector<Point>>>& _curves;
+        const Mat& _frame;
+
+    public:
+        HandFinder(const vector<Detect*>& detectors,
+                   const vector<vector<vector<Point>>>& curves,
+                   const Mat& frame) :
+            _detectors(detectors),
+            _curves(curves),
+            _frame(frame)
+        {}
+
+        void operator()(const Range& range) const
+        {
+            for (int i = range.start; i < range.end; ++i) {
+                _detectors[i]->findHand(_curves[i], _frame);
+            }
+        }
+};
+
+/**
+ * The constructor for DetectConfig
+ *
+ * The constants Detect was tuned with on 640x480 frames
+ */
+
+DetectConfig::DetectConfig() :
+    minContourArea(5000),
+    polyEpsilon(2.0),
+    gridStep(10),
+    regionRadii(3.5),
+    minDefectDepth(20),
+    tipPairing(0.5)
+{}
 
 /**
  * the constructor
  *
- * this does nothing
+ * palmEngine picks how the palm center is found, maxHands how many hands
+ * findHands looks for, and config the thresholds
  */
 
-Detect::Detect()
+Detect::Detect(PalmEngine palmEngine, int maxHands, const DetectConfig& config) :
+    _palmEngine(palmEngine),
+    _config(config),
+    _level(0),
+    _levelScale(1),
+    _polygonTests(0),
+    _maxHands(std::max(1, maxHands))
 {}
 
 /**
  * the destructor
  *
- * this does nothing
+ * this frees the detectors of the hands
  */
 
 Detect::~Detect()
-{}
+{
+    for (size_t i = 0; i < _handDetectors.size(); ++i) {
+        delete _handDetectors[i];
+    }
+}
 
 /**
  * Calculates the euclideanDist between the two points
@@ -61,38 +132,38 @@ double Detect::getAngle(const Point& a,
  * this first finds the contours in the image, filters them out, and finds
  * matching polynomial curves
  *
- * this function returns a vector<vector<Point>>
+ * this function returns a vector<vector<Point>>, which stays valid until the
+ * next call
  */
 
-vector<vector<Point>> Detect::getPolyCurves(Mat& frame)
+const vector<vector<Point>>& Detect::getPolyCurves(Mat& frame)
 {
+    TraceScope trace("detect.contours");
+
     // First find the contours in the image
-    vector<vector<Point>> contours;
-    findContours(frame, contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
+    findContours(frame, _contours, CV_RETR_EXTERNAL, CV_CHAIN_APPROX_NONE);
 
-    // Filter contours by area
-    vector<vector<Point>> goodContours;
+    _pointPool.clear(_polyCurves);
 
-    for (int i = 0; i < contours.size(); ++i) {
-        // an arbitrary amount for now
-        if (contourArea(contours[i]) > 5000) {
-            goodContours.push_back(contours[i]);
+    // the thresholds are in full resolution pixels
+    double scale = 1.0 / _levelScale;
+
+    for (int i = 0; i < _contours.size(); ++i) {
+        // Filter contours by area
+        if (contourArea(_contours[i]) <= _config.minContourArea * scale * scale) {
+            continue;
         }
-    }
 
-    vector<vector<Point>> polyCurves;
-    
-    // Get poly curves for every contour
-    for (int i = 0; i < goodContours.size(); ++i) {
-        vector<Point> current;
-        approxPolyDP(goodContours[i], current, 2.0, false);
+        // Get poly curves for every contour
+        vector<Point>& current = _pointPool.add(_polyCurves);
+        approxPolyDP(_contours[i], current, _config.polyEpsilon * scale, false);
 
-        if(current.size() > 0){
-            polyCurves.push_back(current);
+        if(current.size() < 1){
+            _pointPool.drop(_polyCurves);
         }
     }
 
-    return polyCurves;
+    return _polyCurves;
 }
 
 /** 
@@ -103,59 +174,354 @@ vector<vector<Point>> Detect::getPolyCurves(Mat& frame)
  * curve, not the actual points themselves
  */
 
-vector<vector<int>> Detect::getConvexHulls(vector<vector<Point>>& polyCurves)
+const vector<vector<int>>& Detect::getConvexHulls(vector<vector<Point>>& polyCurves)
 {
-    vector<vector<int>> hullIndices;
+    _indexPool.clear(_hullIndices);
 
     for (int i = 0; i < polyCurves.size(); ++i) {
-        vector<int> hullIndex;
         if (polyCurves[i].size() > 0) {
+            vector<int>& hullIndex = _indexPool.add(_hullIndices);
             convexHull(polyCurves[i], hullIndex);
-            if(hullIndex.size() > 2){
-                hullIndices.push_back(hullIndex);  
-            }
-            else {
-                polyCurves.erase(polyCurves.begin() + i);
+            if(hullIndex.size() <= 2){
+                _indexPool.drop(_hullIndices);
+                _pointPool.erase(polyCurves, i);
                 --i;
             }
         }
     }
 
-    return hullIndices;
+    return _hullIndices;
 }
 
 /**
  * finds the max inscribed circle in the polyCurves we have
  *
- * this works by iterating through the entire image and seeing if the current
- * pixel is the greatest that we have so far
- * doing this, we are able to determine the greatest inscribed circle
+ * the center of this circle is the center of the palm, and its radius the
+ * palm's radius. Only the first curve is considered. How it is found depends
+ * on the palm engine the detector was constructed with
  */
 
 std::pair<Point, double> Detect::findMaxInscribedCircle(
         const vector<vector<Point>>& polyCurves, 
         const Mat& frame)
+{
+    TraceScope trace("detect.palm");
+    _polygonTests = 0;
+
+    if (polyCurves.size() < 1 || polyCurves[0].size() < 1) {
+        _lastPalm = std::pair<Point, double>();
+        return _lastPalm;
+    }
+
+    switch (_palmEngine) {
+        case PALM_GRID:
+            _lastPalm = gridInscribedCircle(polyCurves[0], frame);
+            break;
+        case PALM_COARSE_TO_FINE:
+            _lastPalm = coarseToFineInscribedCircle(polyCurves[0]);
+            break;
+        case PALM_DISTANCE_TRANSFORM:
+        default:
+            _lastPalm = distanceInscribedCircle(polyCurves[0]);
+            break;
+    }
+
+    return _lastPalm;
+}
+
+/**
+ * Returns how many times pointPolygonTest was called by the last
+ * findMaxInscribedCircle, which is how we compare the engines' cost
+ */
+
+int Detect::polygonTests() const
+{
+    return _polygonTests;
+}
+
+/**
+ * Sets the pyramid level of the masks to come
+ *
+ * Level 1 is half the capture resolution and level 2 a quarter, the way
+ * Preprocess leaves the mask with the same level. The contour area cutoff,
+ * the approxPolyDP epsilon, the defect depth cutoff and the step of the grid
+ * engine of the config are all meant in full resolution pixels, so they shrink with the
+ * level and a hand is judged the same at every level. The hands of the
+ * detectors findHands uses follow along
+ */
+
+void Detect::setPyramidLevel(int level)
+{
+    _level = std::max(0, level);
+    _levelScale = 1 << _level;
+
+    for (size_t i = 0; i < _handDetectors.size(); ++i) {
+        _handDetectors[i]->setPyramidLevel(_level);
+    }
+}
+
+/**
+ * Returns the pyramid level of the masks, 0 for full resolution
+ */
+
+int Detect::pyramidLevel() const
+{
+    return _level;
+}
+
+/**
+ * Maps a hand found at the pyramid level to full resolution
+ *
+ * Every point is scaled up, pyrDown centers a pixel of the next level on
+ * the even pixels of the last, so a pixel of the level lands right on a
+ * full resolution one. The tips are then only good to a pixel of the
+ * level, so each is refined in a window of two such pixels around it: the
+ * blurred mask is interpolated at full resolution across the window, and
+ * the tip moves to the pixel of the hand in it farthest from the palm, the
+ * end of the finger. A pixel is in the hand where the mask is non zero, the
+ * edge findContours traced at the level
+ *
+ * mask is the mask the hand was found in, which findContours eats, so the
+ * caller has to keep a copy. Nothing changes at full resolution
+ */
+
+void Detect::toFullResolution(Hand& hand, const Mat& mask)
+{
+    if (_level == 0) {
+        return;
+    }
+
+    int scale = _levelScale;
+    hand.palm.first *= scale;
+    hand.palm.second *= scale;
+    hand.enclosing.first *= (float)scale;
+    hand.enclosing.second *= scale;
+
+    for (size_t i = 0; i < hand.contour.size(); ++i) {
+        hand.contour[i] *= scale;
+    }
+    for (size_t i = 0; i < hand.hull.size(); ++i) {
+        hand.hull[i] *= scale;
+    }
+
+    int radius = 2 * scale;
+    Size window(2 * radius + 1, 2 * radius + 1);
+    const Point& palm = hand.palm.first;
+
+    for (size_t i = 0; i < hand.tips.size(); ++i) {
+        Point corner = hand.tips[i] * scale - Point(radius, radius);
+
+        // the window at full resolution, pixel (x, y) of it is the mask at
+        // ((corner.x + x) / scale, (corner.y + y) / scale)
+        Matx23d toMask(1.0 / scale, 0, (double)corner.x / scale,
+                       0, 1.0 / scale, (double)corner.y / scale);
+        warpAffine(mask, _tipWindow, toMask, window, INTER_LINEAR | WARP_INVERSE_MAP,
+                   BORDER_CONSTANT, Scalar::all(0));
+
+        Point best = hand.tips[i] * scale;
+        double farthest = -1;
+        for (int y = 0; y < window.height; ++y) {
+            const uchar* row = _tipWindow.ptr(y);
+            for (int x = 0; x < window.width; ++x) {
+                if (row[x] == 0) {
+                    continue;
+                }
+
+                Point p = corner + Point(x, y);
+                double dx = p.x - palm.x;
+                double dy = p.y - palm.y;
+                if (dx * dx + dy * dy > farthest) {
+                    farthest = dx * dx + dy * dy;
+                    best = p;
+                }
+            }
+        }
+        hand.tips[i] = best;
+    }
+}
+
+/**
+ * The signed distance from the point to the contour
+ *
+ * Positive inside, negative outside, as pointPolygonTest returns it
+ */
+
+double Detect::polygonDistance(const vector<Point>& polyCurve, const Point& p)
+{
+    ++_polygonTests;
+    return pointPolygonTest(polyCurve, p, true);
+}
+
+/**
+ * finds the max inscribed circle by scanning a grid
+ *
+ * this works by iterating through the entire image and seeing if the current
+ * pixel is the greatest that we have so far
+ * doing this, we are able to determine the greatest inscribed circle, but
+ * only to within the step of the grid, 10 pixels by default
+ */
+
+std::pair<Point, double> Detect::gridInscribedCircle(
+        const vector<Point>& polyCurve,
+        const Mat& frame)
 {
     std::pair<Point, double> c;
     double dist    = -1;
     double maxdist = -1;
 
-    if (polyCurves.size() > 0) {
-        for (int i = 0; i < frame.cols; i+=10) {
-            for (int j = 0; j < frame.rows; j+=10) {
-                dist = pointPolygonTest(polyCurves[0], Point(i,j), true);
-                if (dist > maxdist) {
-                    maxdist = dist;
-                    c.first = Point(i,j);
-                }
+    // every gridStep-th full resolution pixel
+    int step = std::max(1, _config.gridStep / _levelScale);
+
+    for (int i = 0; i < frame.cols; i+=step) {
+        for (int j = 0; j < frame.rows; j+=step) {
+            dist = polygonDistance(polyCurve, Point(i,j));
+            if (dist > maxdist) {
+                maxdist = dist;
+                c.first = Point(i,j);
             }
         }
-        c.second = maxdist;
     }
+    c.second = maxdist;
 
     return c;
 }
 
+/**
+ * finds the max inscribed circle with a distance transform
+ *
+ * the curve is filled into a mask the size of its bounding box (plus a one
+ * pixel border, so the edge of the curve always borders the background).
+ * The distance transform then gives every pixel its distance to the nearest
+ * background pixel, so its maximum is the center of the largest inscribed
+ * circle and the distance is its radius, exact to the pixel
+ */
+
+std::pair<Point, double> Detect::distanceInscribedCircle(const vector<Point>& polyCurve)
+{
+    Rect box = boundingRect(polyCurve);
+
+    _palmMask.create(box.height + 2, box.width + 2, CV_8U);
+    _palmMask.setTo(Scalar::all(0));
+
+    const Point* points = &polyCurve[0];
+    int count = (int)polyCurve.size();
+    fillPoly(_palmMask, &points, &count, 1, Scalar(255), 8, 0, Point(1 - box.x, 1 - box.y));
+
+    distanceTransform(_palmMask, _palmDist, CV_DIST_L2, CV_DIST_MASK_PRECISE);
+
+    double maxdist = 0;
+    Point center;
+    minMaxLoc(_palmDist, 0, &maxdist, 0, &center);
+
+    return std::pair<Point, double>(center + Point(box.x - 1, box.y - 1), maxdist);
+}
+
+/**
+ * finds the max inscribed circle by a coarse to fine search
+ *
+ * without a previous palm, we scan a coarse grid of about 8 by 8 points over
+ * the curve's bounding box and keep the best few. Each of them then climbs
+ * uphill among its 8 neighbours, with the step halved every time it stops
+ * improving, until the step is a single pixel
+ *
+ * with a previous palm inside the curve, we skip the grid and start climbing
+ * from the last center with a step of a quarter of the last radius, since
+ * the palm barely moves between frames
+ *
+ * either way the cost depends on the size of the hand, not of the frame
+ */
+
+std::pair<Point, double> Detect::coarseToFineInscribedCircle(const vector<Point>& polyCurve)
+{
+    const size_t keep = 3;
+
+    Rect box = boundingRect(polyCurve);
+    _palmCandidates.clear();
+
+    int step = 1;
+
+    // start from the last palm if it is still inside the hand
+    if (_lastPalm.second > 0 && box.contains(_lastPalm.first)) {
+        double dist = polygonDistance(polyCurve, _lastPalm.first);
+        if (dist > 0) {
+            _palmCandidates.push_back(std::make_pair(dist, _lastPalm.first));
+            step = std::max(1, (int)(_lastPalm.second / 4));
+        }
+    }
+
+    // otherwise scan a coarse grid and keep the best few points
+    if (_palmCandidates.empty()) {
+        step = std::max(1, std::min(box.width, box.height) / 8);
+
+        for (int x = box.x + step / 2; x < box.x + box.width; x += step) {
+            for (int y = box.y + step / 2; y < box.y + box.height; y += step) {
+                Point p(x, y);
+                _palmCandidates.push_back(std::make_pair(polygonDistance(polyCurve, p), p));
+            }
+        }
+
+        if (_palmCandidates.empty()) {
+            return std::pair<Point, double>(box.tl(), 0);
+        }
+
+        size_t best = std::min(keep, _palmCandidates.size());
+        std::partial_sort(_palmCandidates.begin(), _palmCandidates.begin() + best,
+                _palmCandidates.end(), 
+                [](const std::pair<double, Point>& a, const std::pair<double, Point>& b) {
+                    return a.first > b.first;
+                });
+        _palmCandidates.resize(best);
+    }
+
+    // refine every candidate, halving the step each level
+    for (;; step /= 2) {
+        for (size_t i = 0; i < _palmCandidates.size(); ++i) {
+            climb(polyCurve, _palmCandidates[i], step);
+        }
+
+        if (step <= 1) {
+            break;
+        }
+    }
+
+    std::pair<double, Point> best = _palmCandidates[0];
+    for (size_t i = 1; i < _palmCandidates.size(); ++i) {
+        if (_palmCandidates[i].first > best.first) {
+            best = _palmCandidates[i];
+        }
+    }
+
+    return std::pair<Point, double>(best.second, best.first);
+}
+
+/**
+ * moves a candidate to its best neighbour at the given step until none of
+ * its 8 neighbours is any further from the contour
+ */
+
+void Detect::climb(const vector<Point>& polyCurve, std::pair<double, Point>& candidate, int step)
+{
+    static const int dx[8] = {-1,  0,  1, -1, 1, -1, 0, 1};
+    static const int dy[8] = {-1, -1, -1,  0, 0,  1, 1, 1};
+
+    // bounded, although the distance strictly increases with every move
+    for (int moves = 0; moves < 64; ++moves) {
+        std::pair<double, Point> next = candidate;
+
+        for (int k = 0; k < 8; ++k) {
+            Point p(candidate.second.x + dx[k] * step, candidate.second.y + dy[k] * step);
+            double dist = polygonDistance(polyCurve, p);
+            if (dist > next.first) {
+                next = std::make_pair(dist, p);
+            }
+        }
+
+        if (next.second == candidate.second) {
+            return;
+        }
+        candidate = next;
+    }
+}
 
 /**
  * finds the minimum enclosing circle of the curve
@@ -177,8 +543,8 @@ std::pair<Point2f, float> Detect::findMinEnclosingCircle(const vector<vector<Poi
 /**
  * gets the region of interest of the curve
  *
- * we do this by truncating contours that are not within 3.5 times of the max
- * inscribed circle's radius.
+ * we do this by truncating contours that are not within 3.5 times (the
+ * regionRadii of the config) of the max inscribed circle's radius.
  * 
  * We've found this to be a rather accurate heuristic in general
  */
@@ -189,17 +555,17 @@ void Detect::getRegionOfInterest(
         const std::pair<Point, double>& maxCircle)
 {
     for (int i = 0; i < polyCurves.size(); i++) {
-        vector<Point> goodContour;
+        vector<Point>& goodContour = _pointPool.add(goodPolyCurves);
         for(int j = 0; j < polyCurves[i].size(); j++) {
-            Point current = polyCurves[i][j];
-            if (euclideanDist(current, maxCircle.first) < 3.5 * maxCircle.second) {
+            const Point& current = polyCurves[i][j];
+            if (euclideanDist(current, maxCircle.first) < _config.regionRadii * maxCircle.second) {
                 goodContour.push_back(current);
             }
         }
 
         // DO NOT ADD POLY CURVE IF FEWER THAN 3 POINTS SINCE CANNOT HAVE HULL INDEX
-        if(goodContour.size() > 3){
-            goodPolyCurves.push_back(goodContour);
+        if(goodContour.size() <= 3){
+            _pointPool.drop(goodPolyCurves);
         }
     }
 }
@@ -207,137 +573,285 @@ void Detect::getRegionOfInterest(
 /**
  * The main interface call to Detect
  *
- * This function takes in a preprocessed frame and outputs information about the hand in the image
+ * This function takes in a preprocessed frame and finds the hand in it with
+ * findHand, in the first contour large enough to be one. The frame is eaten
+ * by findContours
  *
- * This involves:
+ * The Hand returned holds:
+ *   * The max inscribed circle, the palm
  *   * The min enclosing circle
- *   * The max inscribed circle
- *   * The location of the finger points
+ *   * The contour near the palm, its convex hull and convexity defects
+ *   * The location of the finger tips
+ *   * The time each step took
  *
- * Returns a pair with a vector of finger tip Points and another Pair describing the max inscribed circle
+ * It stays valid until the next call. To find more than one hand, use findHands
  */
 
-std::pair<vector<Point>, std::pair<Point,double>> Detect::operator() (Mat& frame, Mat& raw, int count)
+const Hand& Detect::operator() (Mat& frame)
 {
-    vector<Point> tips;
+    int64 start = getTickCount();
 
     // first find the curves in the image
-    vector<vector<Point>> polyCurves = getPolyCurves(frame);
+    const vector<vector<Point>>& polyCurves = getPolyCurves(frame);
+    double contourMs = msSince(start);
 
-    //std::cout << polyCurves.size() << std::endl;
+    findHand(polyCurves, frame);
+    _hand.contourMs = contourMs;
+    _hand.totalMs = msSince(start);
+    return _hand;
+}
 
-    // Find max inscribed circle for the 0th polycurve and draw it.
-    std::pair<Point, double> maxCircle = findMaxInscribedCircle(polyCurves, raw);
+/**
+ * Finds every hand in a preprocessed frame
+ *
+ * Every curve getPolyCurves keeps is taken to be a hand, so two people at
+ * the camera give two hands rather than whichever of them findContours
+ * happened to list first. The curves are ranked by area and the largest
+ * _maxHands of them are handed to a detector each, which finds its hand
+ * exactly as findHand does for a single curve. The detectors have nothing
+ * in common, so they run in parallel on OpenCV's worker threads, which stay
+ * up from one frame to the next
+ *
+ * Each curve goes to the detector whose last palm lies inside it, so a
+ * detector follows its hand rather than a rank. When two hands swap rank
+ * from one frame to the next, the coarse to fine engine still starts from
+ * the palm of the same hand
+ *
+ * The hands come back largest first and stay valid until the next call.
+ * While the number of hands stays the same, the workspace the first few
+ * frames sized is reused rather than allocated again. The OpenCV calls,
+ * findContours, approxPolyDP, convexityDefects and distanceTransform, still
+ * allocate scratch memory of their own
+ */
+
+const vector<Hand>& Detect::findHands(Mat& frame)
+{
+    int64 start = getTickCount();
+
+    const vector<vector<Point>>& polyCurves = getPolyCurves(frame);
+    double contourMs = msSince(start);
+
+    _curveAreas.clear();
+    for (int i = 0; i < polyCurves.size(); ++i) {
+        _curveAreas.push_back(std::make_pair(contourArea(polyCurves[i]), i));
+    }
+
+    int count = std::min<int>(_maxHands, _curveAreas.size());
+    std::partial_sort(_curveAreas.begin(), _curveAreas.begin() + count, _curveAreas.end(),
+            [](const std::pair<double, int>& a, const std::pair<double, int>& b) {
+                return a.first > b.first;
+            });
+
+    while (_handDetectors.size() < count) {
+        _handDetectors.push_back(new Detect(_palmEngine, 1, _config));
+        _handDetectors.back()->setPyramidLevel(_level);
+        _handCurves.push_back(vector<vector<Point>>(1));
+    }
 
-    circle(raw, maxCircle.first, maxCircle.second, cv::Scalar(220,75,20), 1, CV_AA);
+    for (int i = 0; i < count; ++i) {
+        const vector<Point>& curve = polyCurves[_curveAreas[i].second];
+        _handCurves[i][0] = curve;
 
-    // Good PolyCurve is with 3.5 * max inscribed radius
-    vector<vector<Point>> goodPolyCurves;
-    getRegionOfInterest(goodPolyCurves, polyCurves, maxCircle);
+        // the detectors before i are taken, a detector with no palm has no hand to follow
+        for (int j = i; j < _handDetectors.size(); ++j) {
+            const std::pair<Point, double>& last = _handDetectors[j]->_lastPalm;
+            if (last.second > 0 && pointPolygonTest(curve, last.first, false) >= 0) {
+                std::swap(_handDetectors[i], _handDetectors[j]);
+                break;
+            }
+        }
+    }
 
-    // draw good poly curve
-    drawContours(raw,goodPolyCurves, -1 , cv::Scalar(0,255,0), 2);
+    parallel_for_(Range(0, count), HandFinder(_handDetectors, _handCurves, frame));
 
-    // Find min enclosing circle on goodPolyCurve and draw it
-    std::pair<Point2f, double> minCircle = findMinEnclosingCircle(goodPolyCurves);
-    circle(raw, minCircle.first, minCircle.second, cv::Scalar(220,75,20), 1, CV_AA);
+    // copying into the hands of the last frame reuses their buffers
+    _hands.resize(count);
+    for (int i = 0; i < count; ++i) {
+        _hands[i] = _handDetectors[i]->_hand;
+        _hands[i].contourMs = contourMs;
+        _hands[i].totalMs += contourMs;
+    }
+
+    return _hands;
+}
+
+/**
+ * Finds the hand in the polynomial curves of a frame
+ *
+ * This is everything operator() does after getPolyCurves. Every intermediate
+ * result lives in the workspace of the class, so once the first few frames
+ * have sized it, none of them is allocated again, though the OpenCV calls
+ * allocate scratch of their own. Nothing is drawn, the
+ * returned Hand holds everything a Visualizer needs to do that
+ */
+
+const Hand& Detect::findHand(const vector<vector<Point>>& polyCurves, const Mat& frame)
+{
+    int64 start = getTickCount();
+
+    _hand.contour.clear();
+    _hand.hull.clear();
+    _hand.defects.clear();
+    _hand.tips.clear();
+    _hand.contourMs = 0;
+    _hand.fingerMs = 0;
+
+    // Find max inscribed circle for the 0th polycurve
+    std::pair<Point, double> maxCircle = findMaxInscribedCircle(polyCurves, frame);
+    _hand.palm = maxCircle;
+
+    // Good PolyCurve is within regionRadii * max inscribed radius
+    _pointPool.clear(_goodPolyCurves);
+    getRegionOfInterest(_goodPolyCurves, polyCurves, maxCircle);
+
+    // Find min enclosing circle on goodPolyCurve
+    _hand.enclosing = findMinEnclosingCircle(_goodPolyCurves);
+    _hand.palmMs = msSince(start);
 
     // now find the convex hull for each polyCurve
-    if (goodPolyCurves.size() < 1) {
-        return std::pair<vector<Point>, std::pair<Point, double>>(tips, maxCircle);
+    if (_goodPolyCurves.size() < 1) {
+        _hand.totalMs = _hand.palmMs;
+        return _hand;
     }
 
+    int64 fingerStart = getTickCount();
+    TraceScope trace("detect.hull");
+
     // Get convex hulls
-    vector<vector<int>> hullIndices = getConvexHulls(goodPolyCurves);
-
-    vector<vector<Point>> hullPoints;
-    for(int i = 0; i < goodPolyCurves.size(); i++) {
-        if (goodPolyCurves[i].size() > 0) {
-            vector<Point> hullPoint;
-            convexHull(goodPolyCurves[i], hullPoint);
-            hullPoints.push_back(hullPoint);
+    const vector<vector<int>>& hullIndices = getConvexHulls(_goodPolyCurves);
+
+    _pointPool.clear(_hullPoints);
+    for(int i = 0; i < _goodPolyCurves.size(); i++) {
+        if (_goodPolyCurves[i].size() > 0) {
+            convexHull(_goodPolyCurves[i], _pointPool.add(_hullPoints));
         }
     }
 
-    // Draw the convex hulls
-    drawContours(raw, hullPoints, -1, cv::Scalar(255, 0, 0), 2);
+    // only the first curve is the hand
+    if (_goodPolyCurves.size() > 0) {
+        _hand.contour = _goodPolyCurves[0];
+        _hand.hull = _hullPoints[0];
+    }
 
-    
-    for (int i = 0; i < 1; ++i)
+    for (int i = 0; i < std::min<int>(1, _goodPolyCurves.size()); ++i)
     {
-        vector<Vec4i> defects;
-        
-        // find convexity defects for each poly curve and draw them
-        convexityDefects(goodPolyCurves[i], hullIndices[i], defects);
+        // find convexity defects for each poly curve
+        trace.next("detect.defects");
+        convexityDefects(_goodPolyCurves[i], hullIndices[i], _defects);
 
-        defects = filterDefects(defects);
-        vector<Point> defectEnds;
+        const vector<Vec4i>& defects = filterDefects(_defects);
+        _defectEnds.clear();
 
         for (int j = 0; j < defects.size(); ++j) {
-            Vec4i& defect = defects[j];
+            const Vec4i& defect = defects[j];
 
             int startIdx = defect[0];
             int endIdx = defect[1];
             int farIdx = defect[2];
 
-            Point start = goodPolyCurves[i][startIdx];
-            Point end = goodPolyCurves[i][endIdx];
-            Point far = goodPolyCurves[i][farIdx];
+            Point start = _goodPolyCurves[i][startIdx];
+            Point end = _goodPolyCurves[i][endIdx];
+            Point far = _goodPolyCurves[i][farIdx];
             if(euclideanDist(far, start) > maxCircle.second) {
-                defectEnds.push_back(start);
-                defectEnds.push_back(end);
+                _defectEnds.push_back(start);
+                _defectEnds.push_back(end);
             }
         }
 
-        tips = findFingerTips(defectEnds, maxCircle, raw);
+        trace.next("detect.tips");
+        findFingerTips(_defectEnds, maxCircle);
     }
 
-    flip(raw, raw, 1);
-    imshow("hand", raw);
-
-    // movie code (we should return the frame to HandMade and put movie code there with the others.)
-    if(makeMoviesD) {
-	    char buffer[30];
-	    sprintf(buffer, "detected/detected_%03d.jpg", count++);
-	    imwrite(buffer, raw);
-	}
-
-    return std::pair<vector<Point>, std::pair<Point, double>>(tips, maxCircle);
+    _hand.fingerMs = msSince(fingerStart);
+    _hand.totalMs = msSince(start);
+    return _hand;
 }
 
 /**
- *  Takes a vector of convexity defect endpoints and matches them based on the first match under
- * a length proportionate to the palm radius. Then draws the point on the frame and adds to the return vector
- *  
- * Also filters based on distance from the palm to elimated weird contours on the edge of the arms. This should
- * be moved to the filterDefects method.
+ * Pairs up the convexity defect endpoints that lie on the same finger, and
+ * adds the midpoint of each pair as a finger tip
  *
- * Needs to be improved upon a lot. Currently returns two points for every match which results in 10 return points
- * for 5 fingers. Also it should find the best match (nearest neighbor) instead of the first under some distance.
+ * Two ends are paired when each is the other's nearest end and they are
+ * closer than half the palm radius (the tipPairing of the config), so every
+ * finger gives a single tip. The ends are binned into a grid of cells that
+ * wide and sorted by cell, so an end's partner is always in its own cell or
+ * one of the eight around it, and finding it takes a few binary searches
+ * rather than a pass over every other end. Distances are compared squared
+ *
+ * Tips closer than twice the palm radius to the palm center are dropped,
+ * which gets rid of the odd ends on the edge of the arm. This should be
+ * moved to the filterDefects method.
  */
 
-vector<Point> Detect::findFingerTips(vector<Point> defectEnds, std::pair<Point, double> maxCircle, Mat& raw)
+const vector<Point>& Detect::findFingerTips(
+        const vector<Point>& defectEnds,
+        const std::pair<Point, double>& maxCircle)
 {
-    vector<Point> tips;
-    for(int k = 0; k < defectEnds.size(); k++)
-    {
-        for(int l = 0; l < defectEnds.size(); l++)
-        {
-            if( k != l) {
-                float distance = euclideanDist(defectEnds[k], defectEnds[l]);
-                if (distance < maxCircle.second / 2 ){
+    vector<Point>& tips = _hand.tips;
+    tips.clear();
+
+    int count = (int)defectEnds.size();
+    double reach = maxCircle.second * _config.tipPairing;
+    if (count < 2 || reach <= 0) {
+        return tips;
+    }
 
-                    Point tip = (defectEnds[k] + defectEnds[l])*.5;
+    int cell = std::max(1, (int)std::ceil(reach));
+
+    _endCells.clear();
+    for (int i = 0; i < count; ++i) {
+        int cx = cvFloor((double)defectEnds[i].x / cell);
+        int cy = cvFloor((double)defectEnds[i].y / cell);
+        _endCells.push_back(std::make_pair(cellKey(cx, cy), i));
+    }
+    std::sort(_endCells.begin(), _endCells.end());
+
+    _nearestEnd.assign(count, -1);
+    for (int k = 0; k < count; ++k) {
+        const Point& end = defectEnds[k];
+        int cx = cvFloor((double)end.x / cell);
+        int cy = cvFloor((double)end.y / cell);
+        double best = reach * reach;
+
+        for (int dy = -1; dy <= 1; ++dy) {
+            for (int dx = -1; dx <= 1; ++dx) {
+                long long key = cellKey(cx + dx, cy + dy);
+                vector<std::pair<long long, int>>::const_iterator it =
+                    std::lower_bound(_endCells.begin(), _endCells.end(), std::make_pair(key, -1));
+
+                for (; it != _endCells.end() && it->first == key; ++it) {
+                    int l = it->second;
+                    if (l == k) {
+                        continue;
+                    }
 
-                    float palmDist = euclideanDist(tip, maxCircle.first);
-                    if(palmDist > 2 * maxCircle.second) {
-                        tips.push_back(tip);
-                        circle(raw, tip, 10, Scalar(255, 255, 255), 2);
-                        break;
+                    double ex = defectEnds[l].x - end.x;
+                    double ey = defectEnds[l].y - end.y;
+                    double distance = ex * ex + ey * ey;
+                    if (distance < best) {
+                        best = distance;
+                        _nearestEnd[k] = l;
                     }
                 }
             }
+        }
+    }
+
+    double palmReach = 2 * maxCircle.second;
+    for (int k = 0; k < count; ++k) {
+        int l = _nearestEnd[k];
+
+        // each mutual pair once
+        if (l <= k || _nearestEnd[l] != k) {
+            continue;
+        }
+
+        Point tip = (defectEnds[k] + defectEnds[l])*.5;
 
+        double px = tip.x - maxCircle.first.x;
+        double py = tip.y - maxCircle.first.y;
+        if (px * px + py * py > palmReach * palmReach) {
+            tips.push_back(tip);
         }
     }
     return tips;
@@ -349,17 +863,19 @@ vector<Point> Detect::findFingerTips(vector<Point> defectEnds, std::pair<Point,
  *  of the hand dont however, and this can cause issues with detection.
  */
 
-vector<Vec4i> Detect::filterDefects(const vector<Vec4i> & defects)
+const vector<Vec4i>& Detect::filterDefects(const vector<Vec4i> & defects)
 {
-    vector<Vec4i> filteredDefects;
+    vector<Vec4i>& filtered = _hand.defects;
+    filtered.clear();
     for(int i = 0; i < defects.size(); ++i)
     {
-        Vec4i defect = defects[i];
-        float depth = defect[3] / 256;
+        const Vec4i& defect = defects[i];
+        float depth = defect[3] / 256.0f;
 
-        if(depth > 20) {
-            filteredDefects.push_back(defect);
+        // the depth is in pixels of the pyramid level, the cutoff in full resolution ones
+        if(depth * _levelScale > _config.minDefectDepth) {
+            filtered.push_back(defect);
         }
     }
-    return filteredDefects;
+    return filtered;
 }
@@ -12,57 +12,229 @@
 
 #include <stdexcept>
 
+#include "Workspace.h"
+
 /**
  * The Detect class
  *
- * This represents the main motion detection in our program
+ * This finds the hands in the masks Preprocess makes
  *
- * Constructed with a OpenCV VideoCapture object, this class is responsible for
- * detecting the Hand Detects and returns some kind of data type (not decided
- * yet) that represents the hand gesture in the current frame
+ * Given a mask, operator() takes the first contour large enough to be a hand
+ * and describes it as a Hand: the palm as the max inscribed circle, the min
+ * enclosing circle, the contour near the palm with its convex hull and
+ * convexity defects, and a finger tip for every finger. findHands does the
+ * same for up to maxHands contours at once, largest first, with a child
+ * detector for each
  *
- * As of now, it simply displays the video stream's edges with Canny
+ * The results are plain geometry in the coordinates of the mask, kept in a
+ * workspace that is reused from frame to frame. A mask at a pyramid level is
+ * mapped back to the frame with toFullResolution
  */
 
 using namespace cv;
 
+// the ways findMaxInscribedCircle can locate the palm center
+enum PalmEngine {
+    // pointPolygonTest on every 10th pixel of the frame
+    PALM_GRID,
+
+    // a single distance transform of the contour's bounding box
+    PALM_DISTANCE_TRANSFORM,
+
+    // a coarse grid over the bounding box refined around the best points,
+    // starting from the last palm when there is one
+    PALM_COARSE_TO_FINE
+};
+
+/**
+ * The thresholds Detect judges a frame by
+ *
+ * Every length and area is in full resolution pixels, Detect shrinks them
+ * to its pyramid level itself. The defaults are the constants Detect always
+ * used, which suit a 480 line frame
+ */
+
+struct DetectConfig
+{
+    // contours of a smaller area are not hands
+    double minContourArea;
+
+    // how far approxPolyDP may move the contour
+    double polyEpsilon;
+
+    // the step of the grid the grid engine scans
+    int gridStep;
+
+    // the contour is cut off this many palm radii from the palm center
+    double regionRadii;
+
+    // convexity defects shallower than this are not between fingers
+    double minDefectDepth;
+
+    // defect ends closer than this many palm radii pair up into a finger tip
+    double tipPairing;
+
+    DetectConfig();
+};
+
+/**
+ * Everything Detect found in a frame
+ *
+ * This is plain geometry in the coordinates of the frame. Drawing it is left
+ * to the Visualizer, so finding the hand never pays for rendering
+ */
+
+struct Hand
+{
+    // the max inscribed circle of the contour, the palm
+    std::pair<Point, double> palm;
+
+    // the min enclosing circle of the contour, zero sized when there is no hand
+    std::pair<Point2f, float> enclosing;
+
+    // the contour within regionRadii palm radii of the palm, and its convex hull
+    vector<Point> contour;
+    vector<Point> hull;
+
+    // the convexity defects deep enough to lie between fingers, indexing contour
+    vector<Vec4i> defects;
+
+    // the finger tips, one for every finger
+    vector<Point> tips;
+
+    // the time taken finding the contours, the palm, the fingers and all of it, in ms
+    double contourMs;
+    double palmMs;
+    double fingerMs;
+    double totalMs;
+};
+
 class Detect
 {
     private:
-        
+        // how the max inscribed circle is found
+        PalmEngine _palmEngine;
+
+        // the thresholds, at full resolution
+        DetectConfig _config;
+
+        // the pyramid level the masks come in at, 0 for full resolution, and
+        // how many full resolution pixels a pixel of that level is across
+        int _level;
+        int _levelScale;
+
+        // the full resolution window around a tip, for toFullResolution
+        Mat _tipWindow;
+
+        // scratch buffers for the distance transform engine
+        Mat _palmMask;
+        Mat _palmDist;
+
+        // the last palm found, which seeds the coarse to fine engine
+        std::pair<Point, double> _lastPalm;
+
+        // candidates kept between the levels of the coarse to fine engine
+        vector<std::pair<double, Point>> _palmCandidates;
+
+        // pointPolygonTest calls made by the last findMaxInscribedCircle
+        int _polygonTests;
+
+        // the workspace, sized by the first frames and reused by every frame after
+        vector<vector<Point>> _contours;
+        vector<vector<Point>> _polyCurves;
+        vector<vector<Point>> _goodPolyCurves;
+        vector<vector<Point>> _hullPoints;
+        vector<vector<int>> _hullIndices;
+        vector<Vec4i> _defects;
+        vector<Point> _defectEnds;
+        Hand _hand;
+        VectorPool<Point> _pointPool;
+        VectorPool<int> _indexPool;
+
+        // the defect ends sorted by the grid cell they fall in, and the nearest
+        // other end to each, for findFingerTips
+        vector<std::pair<long long, int>> _endCells;
+        vector<int> _nearestEnd;
+
+        // the most hands findHands looks for, a detector for each of them with
+        // the single curve it is given, the curves ranked by area, and the
+        // hands. The detectors are kept in the order of the hands they found last
+        int _maxHands;
+        vector<Detect*> _handDetectors;
+        vector<vector<vector<Point>>> _handCurves;
+        vector<std::pair<double, int>> _curveAreas;
+        vector<Hand> _hands;
+
+        // a detector owns the detectors of its hands, so it is never copied
+        Detect(const Detect&);
+        Detect& operator=(const Detect&);
+
         // Calculates the angle between the triangle specified
         double getAngle(const Point&, const Point&, const Point&);
 
+        // the max inscribed circle by scanning a grid over the frame
+        std::pair<Point, double> gridInscribedCircle(const vector<Point>&, const Mat&);
+
+        // the max inscribed circle by a distance transform of the contour
+        std::pair<Point, double> distanceInscribedCircle(const vector<Point>&);
+
+        // the max inscribed circle by a coarse to fine search of the contour
+        std::pair<Point, double> coarseToFineInscribedCircle(const vector<Point>&);
+
+        // moves the candidate uphill in steps of the size given until it stops improving
+        void climb(const vector<Point>&, std::pair<double, Point>&, int);
+
+        // the signed distance from the point to the contour, counted in _polygonTests
+        double polygonDistance(const vector<Point>&, const Point&);
+
     public:
-        Detect();
+        Detect(PalmEngine palmEngine = PALM_DISTANCE_TRANSFORM, int maxHands = 1,
+               const DetectConfig& config = DetectConfig());
         ~Detect();
 
         // Calculates the euclideanDist between the two points
         float euclideanDist(const Point&, const Point&);
 
         // finds the polynomial curves in the image
-        vector<vector<Point>> getPolyCurves(Mat&);
+        const vector<vector<Point>>& getPolyCurves(Mat&);
 
         // finds the convex hulls of polynomial curves
-        vector<vector<int>> getConvexHulls(vector<vector<Point>>&);
+        const vector<vector<int>>& getConvexHulls(vector<vector<Point>>&);
 
         // finds the max inscribed circle
         std::pair<Point, double> findMaxInscribedCircle(const vector<vector<Point>>&, const Mat&);
 
+        // the number of pointPolygonTest calls made by the last findMaxInscribedCircle
+        int polygonTests() const;
+
+        // the pyramid level of the masks to come, the thresholds scale with it
+        void setPyramidLevel(int level);
+        int pyramidLevel() const;
+
+        // maps a hand found at the pyramid level to full resolution, refining
+        // its tips in the mask it was found in
+        void toFullResolution(Hand&, const Mat& mask);
+
         // finds the minimum enclosing circle
         std::pair<Point2f, float> findMinEnclosingCircle(const vector<vector<Point>>&);
 
         // determines the region of interest based on the polyCurves passed in
         void getRegionOfInterest(vector<vector<Point>>&, const vector<vector<Point>>&, const std::pair<Point, double>&);
 
-        // the main call to Detect 
-        std::pair<vector<Point>, std::pair<Point,double>> operator() (Mat&, Mat&, int);
+        // the main call to Detect, the hand stays valid until the next call
+        const Hand& operator() (Mat&);
+
+        // finds the hand in the polynomial curves of the frame given
+        const Hand& findHand(const vector<vector<Point>>&, const Mat&);
+
+        // finds every hand in the frame, at most maxHands of them, largest first
+        const vector<Hand>& findHands(Mat&);
 
         // filter defects by depth
-        vector<Vec4i> filterDefects(const vector<Vec4i>& defects);
+        const vector<Vec4i>& filterDefects(const vector<Vec4i>& defects);
 
         // match defect end points and return as finger tip points
-        vector<Point> findFingerTips(vector<Point> defectEnds, std::pair<Point, double> maxCircle, Mat& raw);
+        const vector<Point>& findFingerTips(const vector<Point>& defectEnds, const std::pair<Point, double>& maxCircle);
 
 };
 #endif
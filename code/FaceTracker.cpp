@@ -0,0 +1,188 @@
+#include "FaceTracker.h"
+
+#include <limits>
+
+/**
+ * The constructor for FaceTracker
+ *
+ * Loads the cascade and starts the worker. cadence is how many frames go by
+ * between two detections, and scale is how much each frame is shrunk before
+ * the cascade sees it
+ */
+
+FaceTracker::FaceTracker(const std::string& cascade, int cadence, double scale) :
+    _loaded(_cascade.load(cascade)),
+    _cadence(std::max(1, cadence)),
+    _scale(scale),
+    _frames(0),
+    _due(false),
+    _pendingFrame(0),
+    _hasPending(false),
+    _busy(false),
+    _stop(false),
+    _detectedFrame(0)
+{
+    if (!_loaded) {
+        // an empty cascade turns face detection off on purpose
+        if (!cascade.empty()) {
+            printf("--(!)Error loading\n");
+        }
+        return;
+    }
+
+    _worker = std::thread(&FaceTracker::run, this);
+}
+
+/**
+ * The destructor for FaceTracker
+ *
+ * Stops the worker, letting it finish the detection it is running
+ */
+
+FaceTracker::~FaceTracker()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_one();
+
+    if (_worker.joinable()) {
+        _worker.join();
+    }
+}
+
+/**
+ * Returns whether the cascade was loaded, without it no faces are ever found
+ */
+
+bool FaceTracker::isLoaded() const
+{
+    return _loaded;
+}
+
+/**
+ * Returns the faces predicted for the frame
+ *
+ * Every _cadence frames a detection falls due, and the frame is converted to
+ * grayscale, downscaled and handed to the worker. If it is still busy with
+ * the last one, the detection stays due and the next frame the worker is
+ * free for goes instead. The faces returned are the
+ * latest detection moved along by its velocities for every frame since,
+ * and stay valid until the next call
+ */
+
+const vector<Rect>& FaceTracker::operator()(const Mat& frame)
+{
+    int current = _frames++;
+    _predicted.clear();
+
+    if (!_loaded) {
+        return _predicted;
+    }
+
+    if (current % _cadence == 0) {
+        _due = true;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    if (_due && !_busy && !_hasPending) {
+        _due = false;
+        lock.unlock();
+
+        // only this thread touches _gray and _small
+        cvtColor(frame, _gray, CV_BGR2GRAY);
+        resize(_gray, _small, Size(), _scale, _scale, INTER_AREA);
+
+        lock.lock();
+        cv::swap(_small, _pending);
+        _pendingFrame = current;
+        _hasPending = true;
+        _wake.notify_one();
+    }
+
+    float elapsed = (float)(current - _detectedFrame);
+    for (size_t i = 0; i < _faces.size(); ++i) {
+        Point shift(cvRound(_velocities[i].x * elapsed), cvRound(_velocities[i].y * elapsed));
+        _predicted.push_back(_faces[i] + shift);
+    }
+
+    return _predicted;
+}
+
+/**
+ * The worker loop
+ *
+ * Waits for a pending frame, runs the cascade on it with the lock released,
+ * and stores the faces scaled back to the full frame
+ */
+
+void FaceTracker::run()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    while (true) {
+        _wake.wait(lock, [this] { return _stop || _hasPending; });
+        if (_stop) {
+            return;
+        }
+
+        // the frame is swapped rather than copied, the caller only refills
+        // _pending once the worker is no longer busy
+        cv::swap(_pending, _working);
+        int frame = _pendingFrame;
+        _hasPending = false;
+        _busy = true;
+        lock.unlock();
+
+        int minSize = std::max(1, cvRound(30 * _scale));
+        _cascade.detectMultiScale(_working, _found, 1.3, 2, 0|CV_HAAR_SCALE_IMAGE, Size(minSize, minSize));
+
+        for (size_t i = 0; i < _found.size(); ++i) {
+            _found[i] = Rect(cvRound(_found[i].x / _scale), cvRound(_found[i].y / _scale),
+                             cvRound(_found[i].width / _scale), cvRound(_found[i].height / _scale));
+        }
+
+        lock.lock();
+        store(frame);
+        _busy = false;
+    }
+}
+
+/**
+ * Stores the detection in _found, made on the frame given
+ *
+ * Each face is matched to the nearest face of the last detection, and its
+ * velocity is the distance between their centers over the frames between
+ * them. Faces that are new get no velocity. Called with the lock held
+ */
+
+void FaceTracker::store(int frame)
+{
+    const vector<Rect>& found = _found;
+    float frames = (float)std::max(1, frame - _detectedFrame);
+    vector<Point2f>& velocities = _foundVelocities;
+    velocities.assign(found.size(), Point2f(0, 0));
+
+    for (size_t i = 0; i < found.size(); ++i) {
+        Point2f center(found[i].x + found[i].width * 0.5f, found[i].y + found[i].height * 0.5f);
+
+        float best = std::numeric_limits<float>::max();
+        for (size_t j = 0; j < _faces.size(); ++j) {
+            Point2f last(_faces[j].x + _faces[j].width * 0.5f, _faces[j].y + _faces[j].height * 0.5f);
+            Point2f diff = center - last;
+            float dist = diff.x * diff.x + diff.y * diff.y;
+
+            // a face further than its own width away is another face
+            if (dist < best && dist < found[i].width * found[i].width) {
+                best = dist;
+                velocities[i] = diff * (1.0f / frames);
+            }
+        }
+    }
+
+    _faces = found;
+    _velocities.swap(velocities);
+    _detectedFrame = frame;
+}
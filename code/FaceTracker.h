@@ -0,0 +1,94 @@
+#ifndef FACETRACKER_H
+#define FACETRACKER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/objdetect/objdetect.hpp>
+#include <opencv/cv.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * The FaceTracker class
+ *
+ * This finds the faces in the frame so Preprocess can black them out
+ *
+ * The Haar cascade is far too slow to run on every frame, and faces barely
+ * move between frames, so the cascade runs on a worker thread, on a
+ * downscaled copy of every few frames. In between, each face is moved along
+ * by the velocity measured between its last two detections. Asking for the
+ * faces of a frame never waits for the cascade, it only returns the
+ * prediction from the latest detection that finished
+ */
+
+using namespace cv;
+
+class FaceTracker
+{
+    private:
+        CascadeClassifier _cascade;
+        bool _loaded;
+
+        // run the cascade on one of every _cadence frames, scaled by _scale
+        const int _cadence;
+        const double _scale;
+
+        // the number of frames seen, and whether a detection is due. A due
+        // detection waits for the first frame the worker is free for
+        int _frames;
+        bool _due;
+
+        // the frame converted and shrunk for the worker, and the one the
+        // worker is running on. These three rotate with _pending, so once
+        // sized no frame is allocated
+        Mat _gray;
+        Mat _small;
+        Mat _working;
+
+        // the frame waiting for the worker, and the frame number it came from
+        Mat _pending;
+        int _pendingFrame;
+        bool _hasPending;
+        bool _busy;
+        bool _stop;
+
+        // the latest detection, the frame it came from and the per frame velocities
+        vector<Rect> _faces;
+        vector<Point2f> _velocities;
+        int _detectedFrame;
+
+        // the faces found by the worker and their velocities before they are stored
+        vector<Rect> _found;
+        vector<Point2f> _foundVelocities;
+
+        // the faces predicted for the last frame
+        vector<Rect> _predicted;
+
+        std::mutex _mutex;
+        std::condition_variable _wake;
+        std::thread _worker;
+
+        // the worker loop, running the cascade on whatever frame is pending
+        void run();
+
+        // stores _found, matching it to the last detection to measure velocities
+        void store(int);
+
+    public:
+        FaceTracker(const std::string& cascade, int cadence = 5, double scale = 0.5);
+        ~FaceTracker();
+
+        // true if the cascade file could be loaded
+        bool isLoaded() const;
+
+        // hands the frame to the worker if it is due, and returns its predicted faces
+        const vector<Rect>& operator()(const Mat& frame);
+};
+
+#endif // FACETRACKER_H
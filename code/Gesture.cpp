@@ -0,0 +1,271 @@
+#include "Gesture.h"
+
+#include <algorithm>
+
+/**
+ * The gestures, by the number of fingers they are made with
+ *
+ * The rules are tried in order and the first one whose range holds the
+ * finger count wins. A count no rule holds is no gesture
+ */
+
+static const GestureRule gestureRules[] = {
+    // gesture            fingers  enter  exit
+    { GESTURE_POINT,      1, 2,    2,     3 },
+    { GESTURE_OPEN_PALM,  4, 5,    3,     3 },
+    { GESTURE_FIST,       0, 0,    3,     2 }
+};
+
+/**
+ * The changes from one gesture to another that zoom, closing the hand zooms
+ * out and opening it zooms in
+ */
+
+static const GestureTransition gestureTransitions[] = {
+    { GESTURE_OPEN_PALM, GESTURE_FIST,      0.8 },
+    { GESTURE_FIST,      GESTURE_OPEN_PALM, 1.25 }
+};
+
+static const int gestureRuleCount = sizeof(gestureRules) / sizeof(gestureRules[0]);
+static const int gestureTransitionCount = sizeof(gestureTransitions) / sizeof(gestureTransitions[0]);
+
+// the most events a single frame can cause: an end, a zoom and a start. A
+// frame that starts a gesture does not move it as well
+static const int maxGestureEvents = 3;
+
+/**
+ * Picks out of the hand what the gestures are told apart by
+ */
+
+GestureFeatures gestureFeatures(const Hand& hand, double time)
+{
+    GestureFeatures features;
+    features.time = time;
+    features.fingers = (int)hand.tips.size();
+    features.palm = Point2f((float)hand.palm.first.x, (float)hand.palm.first.y);
+    features.palmRadius = (float)hand.palm.second;
+    features.pointer = hand.tips.empty() ? features.palm : Point2f((float)hand.tips[0].x, (float)hand.tips[0].y);
+    return features;
+}
+
+/**
+ * The constructor for GestureRecognizer
+ */
+
+GestureRecognizer::GestureRecognizer()
+{
+    _events.reserve(maxGestureEvents);
+    reset();
+}
+
+/**
+ * The destructor for GestureRecognizer
+ *
+ * As of now this does nothing
+ */
+
+GestureRecognizer::~GestureRecognizer()
+{}
+
+/**
+ * Returns the rule for a gesture, or 0 for GESTURE_NONE
+ */
+
+const GestureRule* GestureRecognizer::rule(Gesture gesture)
+{
+    for (int i = 0; i < gestureRuleCount; ++i) {
+        if (gestureRules[i].gesture == gesture) {
+            return &gestureRules[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns where a gesture is in a frame, the pointer for pointing and the
+ * palm for everything else
+ */
+
+Point2f GestureRecognizer::position(Gesture gesture, const GestureFeatures& features)
+{
+    return gesture == GESTURE_POINT ? features.pointer : features.palm;
+}
+
+/**
+ * Returns the slot of _fingerCounts a finger count goes in, any count above
+ * _maxFingers shares the last one
+ */
+
+static int fingerSlot(int fingers, int maxFingers)
+{
+    return fingers < maxFingers ? fingers : maxFingers;
+}
+
+/**
+ * Adds a frame to the window
+ *
+ * The counts are kept up to date as frames come and go, so nothing has to be
+ * counted over again
+ */
+
+void GestureRecognizer::push(const GestureFeatures& features)
+{
+    if (_size == _windowSize) {
+        const GestureFeatures& oldest = _window[_head];
+        if (oldest.palmRadius > 0) {
+            --_handFrames;
+            --_fingerCounts[fingerSlot(oldest.fingers, _maxFingers)];
+        }
+        _head = (_head + 1) % _windowSize;
+        --_size;
+    }
+
+    _window[(_head + _size) % _windowSize] = features;
+    ++_size;
+
+    if (features.palmRadius > 0) {
+        ++_handFrames;
+        ++_fingerCounts[fingerSlot(features.fingers, _maxFingers)];
+    }
+}
+
+/**
+ * Returns the gesture the window shows
+ *
+ * There is no gesture unless most of the window has a hand in it. Otherwise
+ * the finger count is the one most frames of the window have, the higher
+ * count on a tie, and it is looked up in the rules
+ */
+
+Gesture GestureRecognizer::classify() const
+{
+    if (2 * _handFrames <= _size) {
+        return GESTURE_NONE;
+    }
+
+    int fingers = 0;
+    for (int i = 1; i <= _maxFingers; ++i) {
+        if (_fingerCounts[i] >= _fingerCounts[fingers]) {
+            fingers = i;
+        }
+    }
+
+    for (int i = 0; i < gestureRuleCount; ++i) {
+        if (fingers >= gestureRules[i].minFingers && fingers <= gestureRules[i].maxFingers) {
+            return gestureRules[i].gesture;
+        }
+    }
+    return GESTURE_NONE;
+}
+
+/**
+ * Appends an event
+ */
+
+void GestureRecognizer::emit(GestureEventType type, Gesture gesture,
+                             const Point2f& position, const Point2f& delta, double scale)
+{
+    GestureEvent event;
+    event.type = type;
+    event.gesture = gesture;
+    event.position = position;
+    event.delta = delta;
+    event.scale = scale;
+    _events.push_back(event);
+}
+
+/**
+ * Adds the features of the next frame and returns the events it caused
+ *
+ * A gesture other than the active one has to be seen for its rule's
+ * enterFrames, and at least for the active rule's exitFrames, before it
+ * takes over. Taking over ends the active gesture, zooms if the change is in
+ * the transitions table, and starts the new one. A gesture that goes on
+ * reports how far it moved. The events belong to the recognizer and are
+ * replaced on the next update
+ */
+
+const std::vector<GestureEvent>& GestureRecognizer::update(const GestureFeatures& features)
+{
+    _events.clear();
+    push(features);
+
+    Gesture seen = classify();
+    Point2f none(0, 0);
+
+    if (seen == _active) {
+        _candidate = _active;
+        _candidateFrames = 0;
+    }
+    else {
+        if (seen == _candidate) {
+            ++_candidateFrames;
+        }
+        else {
+            _candidate = seen;
+            _candidateFrames = 1;
+        }
+
+        const GestureRule* enter = rule(seen);
+        const GestureRule* exit = rule(_active);
+        int needed = std::max(enter ? enter->enterFrames : 1, exit ? exit->exitFrames : 1);
+
+        if (_candidateFrames >= needed) {
+            if (_active != GESTURE_NONE) {
+                emit(GESTURE_END, _active, _lastPosition, none, 1);
+            }
+
+            for (int i = 0; i < gestureTransitionCount; ++i) {
+                if (gestureTransitions[i].from == _active && gestureTransitions[i].to == seen) {
+                    emit(GESTURE_ZOOM, seen, position(seen, features), none, gestureTransitions[i].scale);
+                }
+            }
+
+            _active = seen;
+            _candidateFrames = 0;
+            _lastPosition = position(_active, features);
+
+            if (_active != GESTURE_NONE) {
+                emit(GESTURE_START, _active, _lastPosition, none, 1);
+            }
+            return _events;
+        }
+    }
+
+    // the gesture goes on where the hand is now, if the hand, and for
+    // pointing a finger, was found in this frame
+    bool found = features.palmRadius > 0 && (_active != GESTURE_POINT || features.fingers > 0);
+    if (_active != GESTURE_NONE && found) {
+        Point2f now = position(_active, features);
+        emit(GESTURE_MOVE, _active, now, now - _lastPosition, 1);
+        _lastPosition = now;
+    }
+    return _events;
+}
+
+/**
+ * Returns the gesture being made
+ */
+
+Gesture GestureRecognizer::active() const
+{
+    return _active;
+}
+
+/**
+ * Empties the window and ends the gesture, quietly
+ */
+
+void GestureRecognizer::reset()
+{
+    _head = 0;
+    _size = 0;
+    _handFrames = 0;
+    std::fill(_fingerCounts, _fingerCounts + _maxFingers + 1, 0);
+
+    _active = GESTURE_NONE;
+    _candidate = GESTURE_NONE;
+    _candidateFrames = 0;
+    _lastPosition = Point2f(0, 0);
+    _events.clear();
+}
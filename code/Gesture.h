@@ -0,0 +1,180 @@
+#ifndef GESTURE_H
+#define GESTURE_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "Detect.h"
+
+using namespace cv;
+
+// the gestures a hand can make
+enum Gesture {
+    GESTURE_NONE,
+
+    // one or two fingers up, which draws
+    GESTURE_POINT,
+
+    // the whole hand open, which erases or pans the whiteboard
+    GESTURE_OPEN_PALM,
+
+    // no fingers up
+    GESTURE_FIST
+};
+
+// what a GestureRecognizer reports
+enum GestureEventType {
+    // a gesture was recognized, at the position given
+    GESTURE_START,
+
+    // a gesture is still held, and moved by delta since the last frame
+    GESTURE_MOVE,
+
+    // a gesture is over
+    GESTURE_END,
+
+    // the hand went from one gesture to another that zooms, by scale
+    GESTURE_ZOOM
+};
+
+// the little a GestureRecognizer needs to know about a frame
+struct GestureFeatures
+{
+    // the capture time of the frame, in seconds
+    double time;
+
+    // the number of finger tips
+    int fingers;
+
+    // the palm center and radius, the radius is zero when there is no hand
+    Point2f palm;
+    float palmRadius;
+
+    // the first finger tip, where a pointing hand points
+    Point2f pointer;
+};
+
+// an event, for the gesture it is about
+struct GestureEvent
+{
+    GestureEventType type;
+    Gesture gesture;
+
+    // the pointer for GESTURE_POINT, the palm for the other gestures
+    Point2f position;
+
+    // how far the position moved since the last frame, for GESTURE_MOVE
+    Point2f delta;
+
+    // how much to zoom by, for GESTURE_ZOOM
+    double scale;
+};
+
+// a row of the table the gestures are classified by
+struct GestureRule
+{
+    Gesture gesture;
+
+    // the range of finger counts the gesture is made with
+    int minFingers;
+    int maxFingers;
+
+    // the frames in a row the gesture has to be seen in before it starts, and
+    // the frames in a row it has to be missing from before it ends
+    int enterFrames;
+    int exitFrames;
+};
+
+// a row of the table of changes from one gesture to another that zoom
+struct GestureTransition
+{
+    Gesture from;
+    Gesture to;
+    double scale;
+};
+
+// the features of the hand Detect found, captured at the time given in seconds
+GestureFeatures gestureFeatures(const Hand& hand, double time);
+
+/**
+ * The GestureRecognizer class
+ *
+ * This turns the hand found in every frame into gestures, and the gestures
+ * into events for main to act on
+ *
+ * The last few frames are kept in a window, and the finger count the hand is
+ * classified by is the one most of the window agrees on, so a finger missed
+ * in a single frame changes nothing. The count is looked up in a table of
+ * rules, fixed at compile time in Gesture.cpp, which is the one place to add
+ * a gesture. A new gesture only takes over once it has been seen for long
+ * enough to start and the old one has been missing for long enough to end,
+ * and the changes from one gesture to another are looked up in a second
+ * table for the ones that zoom
+ *
+ * The window and the tables have fixed sizes and the events go into a vector
+ * reserved up front, so update takes the same few steps every frame and
+ * never allocates. It works on GestureFeatures rather than on images, so it
+ * can be driven by a recorded sequence of them
+ */
+
+class GestureRecognizer
+{
+    private:
+        // the frames in the window, and the most fingers counted apart
+        static const int _windowSize = 3;
+        static const int _maxFingers = 5;
+
+        // the last frames, oldest first from _head
+        GestureFeatures _window[_windowSize];
+        int _head;
+        int _size;
+
+        // how many frames of the window have each finger count, and a hand at all
+        int _fingerCounts[_maxFingers + 1];
+        int _handFrames;
+
+        // the gesture being made, and the one that may take over and for how long it has been seen
+        Gesture _active;
+        Gesture _candidate;
+        int _candidateFrames;
+
+        // where the active gesture was in the last frame
+        Point2f _lastPosition;
+
+        std::vector<GestureEvent> _events;
+
+        // adds a frame to the window, pushing the oldest out once it is full
+        void push(const GestureFeatures&);
+
+        // the gesture the window shows, by the rules table
+        Gesture classify() const;
+
+        // the position of a gesture in a frame
+        static Point2f position(Gesture, const GestureFeatures&);
+
+        // appends an event
+        void emit(GestureEventType, Gesture, const Point2f& position, const Point2f& delta, double scale);
+
+    public:
+        GestureRecognizer();
+        ~GestureRecognizer();
+
+        // adds the features of the next frame, returning the events it caused
+        const std::vector<GestureEvent>& update(const GestureFeatures&);
+
+        // the gesture being made
+        Gesture active() const;
+
+        // forgets the window and ends the gesture, without an event
+        void reset();
+
+        // the rule for a gesture, or 0 if it has none
+        static const GestureRule* rule(Gesture);
+};
+
+#endif // GESTURE_H
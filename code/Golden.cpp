@@ -0,0 +1,124 @@
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "Corpus.h"
+
+/**
+ * the golden output runner
+ *
+ * this runs the pipeline over every frame of a corpus (see Corpus.h) and
+ * compares what it makes of each frame with the reference in golden.yml,
+ * printing every frame that strays too far from it. The exit code is the
+ * number of such frames, capped at 100, so it can gate a change
+ *
+ * with --record the results become the reference instead, of the frames the
+ * golden.yml lists or, the first time, of the frames the pattern given
+ * numbers from zero. Recording again is how a change that is meant to change
+ * the output is accepted
+ *
+ * with --config the frames run with a preset or a config file (see Config.h),
+ * and with --level at a pyramid level (see Preprocess), and are compared with
+ * the reference in full resolution pixels, to see what a preset or a coarser
+ * level costs in accuracy
+ *
+ * usage: Golden <corpus dir> [--record [frame pattern]] [--palm px] [--radius px]
+ *               [--tip px] [--area fraction] [--exact] [--config preset or file]
+ *               [--level 0-2]
+ */
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0]
+                  << " <corpus dir> [--record [frame pattern]] [--palm px] [--radius px]"
+                  << " [--tip px] [--area fraction] [--exact] [--config preset or file]"
+                  << " [--level 0-2]" << std::endl;
+        return 1;
+    }
+
+    Corpus corpus(argv[1]);
+    Config config;
+    GoldenTolerance tolerance;
+    bool record = false;
+    std::string pattern;
+
+    for (int i = 2; i < argc; ++i) {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--record") == 0) {
+            record = true;
+            if (hasValue && argv[i + 1][0] != '-') {
+                pattern = argv[++i];
+            }
+        }
+        else if (strcmp(argv[i], "--exact") == 0) {
+            tolerance.exactMask = true;
+        }
+        else if (strcmp(argv[i], "--palm") == 0 && hasValue) {
+            tolerance.palm = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--radius") == 0 && hasValue) {
+            tolerance.radius = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--tip") == 0 && hasValue) {
+            tolerance.tip = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--area") == 0 && hasValue) {
+            tolerance.maskArea = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--config") == 0 && hasValue) {
+            ++i;
+            if (!applyPreset(argv[i], config) && !loadConfig(argv[i], config)) {
+                std::cerr << "could not read the config " << argv[i] << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--level") == 0 && hasValue) {
+            config.pyramidLevel = atoi(argv[++i]);
+        }
+        else {
+            std::cerr << "unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+
+    corpus.setConfig(config);
+    bool loaded = corpus.load();
+    if (!loaded && !(record && !pattern.empty() && corpus.addFrames(pattern) > 0)) {
+        std::cerr << argv[1] << ": no golden.yml, and no frames to record" << std::endl;
+        return 1;
+    }
+
+    int64 start = getTickCount();
+    std::vector<GoldenFrame> results;
+    if (!corpus.run(results)) {
+        std::cerr << argv[1] << ": could not read the background" << std::endl;
+        return 1;
+    }
+    double seconds = (getTickCount() - start) / getTickFrequency();
+
+    if (record) {
+        corpus.setFrames(results);
+        if (!corpus.save()) {
+            std::cerr << argv[1] << ": could not write golden.yml" << std::endl;
+            return 1;
+        }
+        printf("%d frames recorded in %.2f s\n", (int)results.size(), seconds);
+        return 0;
+    }
+
+    int failed = 0;
+    const std::vector<GoldenFrame>& frames = corpus.frames();
+    for (size_t i = 0; i < frames.size(); ++i) {
+        std::string difference = compareGolden(frames[i], results[i], tolerance);
+        if (!difference.empty()) {
+            printf("%s: %s\n", frames[i].file.c_str(), difference.c_str());
+            ++failed;
+        }
+    }
+
+    printf("%d of %d frames differ, %.2f s\n", failed, (int)frames.size(), seconds);
+    return std::min(failed, 100);
+}
@@ -1,7 +1,19 @@
 #include <iostream>
+#include <mutex>
 
+#include "Background.h"
+#include "Canvas.h"
+#include "Config.h"
 #include "Detect.h"
+#include "Gesture.h"
+#include "Pipeline.h"
 #include "Preprocess.h"
+#include "Recorder.h"
+#include "RoiTracker.h"
+#include "StrokeLog.h"
+#include "TipTracker.h"
+#include "Trace.h"
+#include "Visualizer.h"
 
 #ifdef __APPLE__
 #include <GLUT/glut.h>
@@ -11,55 +23,128 @@
 
 bool makeMovies = FALSE;
 
+// record each movie into a single video file rather than a folder of images
+bool makeVideos = FALSE;
+
+// whether the detected hand is drawn over the camera frame in the "hand"
+// window, building with HEADLESS=1 compiles that out altogether
+bool showHand = true;
+
+// frames averaged before the background is used, and how fast it adapts after
+int backgroundWarmup = 60;
+double backgroundLearningRate = 0.01;
+
+// how many frames go by before Preprocess picks up the adapted background
+int backgroundRefresh = 30;
+
+// how many frames can wait between two pipeline stages, and what happens to
+// the oldest of them when a stage falls behind the camera
+size_t pipelineCapacity = 2;
+DropPolicy pipelineDropPolicy = DROP_OLDEST;
+
+// the config file (see Config.h) read at startup, unless a preset or another
+// file is named on the command line. It sets the capture size, the pyramid
+// level the hand is processed at and how many hands are looked for, among
+// others. The largest hand draws. With a single hand only the pixels around
+// it are preprocessed, with more the whole frame is, so a second hand can be
+// found anywhere. At a pyramid level the hands are mapped back to the
+// capture resolution, finger tips refined, before they are drawn
+std::string configFile = "handmade.yml";
+
+// record every stroke on the whiteboard into a compact log, and a log to draw
+// onto the whiteboard before the session starts (none if empty)
+bool recordStrokes = FALSE;
+std::string strokeLogPath = "session.strokes";
+std::string replayLogPath = "";
+
+// how the drawing finger tip is smoothed, and whether it is carried on to
+// where it should be by the time its frame is drawn, to hide the latency
+TipFilterEngine tipFilterEngine = TIP_FILTER_ONE_EURO;
+bool predictTips = true;
+
+// how many frames in a row a finger tip has to be seen before it can draw,
+// and how many it can then be missed in before its stroke ends
+int tipBirthFrames = 3;
+int tipDeathFrames = 5;
+
+// whether an open palm pans the whiteboard rather than erasing it, and
+// whether opening and closing the hand zooms it
+bool palmPans = false;
+bool fistZooms = true;
+
+// time every stage of every frame, printing the percentiles of each stage
+// every so many frames and writing the last few thousand stages of every
+// thread out as a Chrome trace (none if empty) on the way out
+bool traceStages = FALSE;
+int traceSummaryFrames = 300;
+std::string traceFile = "trace.json";
+
 /**
- * gets the background of the video
+ * warms up the background model
  *
- * this runs first our procedure
- * the function itself is implemented using a simple rolling average
+ * this runs first in our procedure
+ * frames are averaged until the model has seen enough of them, at which
+ * point the background window closes and the main loop takes over
  */
 
-Mat getBackground(VideoCapture& cap){
-    // initailize the count, and the frames
-    int i = 1;
-    Mat frame, frame2, sum;
-
-    cap >> frame;
-    frame2 = frame;
+void warmUpBackground(VideoCapture& cap, Background& bg){
+    Mat frame;
 
-    // the main loop (termiantes when a key is pressed);
-    while (true) {
+    while (!bg.isReady()) {
         cap >> frame;
-        if (i > 1) {
-            frame2 = sum;
-        }
+        bg.update(frame);
 
-        double beta = 1.0 / (i + 1);
-        double alpha = 1.0 - beta; 
-        addWeighted(frame2, alpha, frame, beta, 0.0, sum);
-
-        imshow("background", sum);
-        if(waitKey(30) >= 0) break;
-        ++i;
+        imshow("background", bg.background());
+        waitKey(1);
     }
 
     destroyWindow("background");
-    return sum;
 }
 
 /**
  * the keyboard handler function
  * this is called after each frame is displayed in main
+ *
+ * returns false once the user asked to quit, so main can stop the pipeline
+ * first. The wait is only long enough for highgui to draw, since main already
+ * waits on the pipeline for every frame
+ *
+ * w, a, s and d pan the whiteboard, + and - zoom it around its center, and 0
+ * goes back to where it started
  */
 
-void keyboardHandler() 
+bool keyboardHandler(Canvas& canvas, const Size& view) 
 {
-    int key = waitKey(30);
+    int key = waitKey(1);
+    Point center(view.width / 2, view.height / 2);
+
     switch (key) {
         case 'q':
-            destroyAllWindows();
-            exit(0);
+            return false;
+        case 'w':
+            canvas.pan(Point2f(0, -view.height / 8));
+            break;
+        case 's':
+            canvas.pan(Point2f(0, view.height / 8));
+            break;
+        case 'a':
+            canvas.pan(Point2f(-view.width / 8, 0));
+            break;
+        case 'd':
+            canvas.pan(Point2f(view.width / 8, 0));
+            break;
+        case '+':
+        case '=':
+            canvas.zoom(1.25, center);
+            break;
+        case '-':
+            canvas.zoom(0.8, center);
+            break;
+        case '0':
+            canvas.setViewport(Point2f(0, 0), 1);
             break;
     }
+    return true;
 }
 
 /**
@@ -67,85 +152,293 @@ void keyboardHandler()
  * 
  * there are several options avaible here, one of which is to record the frame
  * as a video
+ *
+ * usage: HandMade [preset or config file], the presets are default,
+ * low-latency, accurate and 1080p. Without one configFile is read if there is
+ * one, and the defaults are used if not
  */
 
 int main(int argc, char **argv)
 {
+    Config config;
+    std::string source = argc > 1 ? argv[1] : configFile;
+    if (!applyPreset(source, config) && !loadConfig(source, config) && argc > 1) {
+        std::cerr << "could not read the config " << source << std::endl;
+        return 1;
+    }
+
     cvNamedWindow("HandMade");
+    setTracing(traceStages);
 
     // Setup capture object
     cv::VideoCapture cap(0);
-    cap.set(CV_CAP_PROP_FRAME_WIDTH, 640);
-    cap.set(CV_CAP_PROP_FRAME_HEIGHT, 480);
+    cap.set(CV_CAP_PROP_FRAME_WIDTH, config.frameSize.width);
+    cap.set(CV_CAP_PROP_FRAME_HEIGHT, config.frameSize.height);
+
+    int frameWidth = config.frameSize.width;
+    int frameHeight = config.frameSize.height;
+
+    // Setup the background model, preprocessor and detector
+    Background bg(backgroundWarmup, backgroundLearningRate);
+    warmUpBackground(cap, bg);
+
+    Preprocess p(bg.background(), "frontal_face.xml", config.preprocess);
+    p.setPyramidLevel(config.pyramidLevel);
+
+    // Detect only finds the hands, drawing them is up to the visualizer
+    Detect d(config.palmEngine, config.maxHands, scaleDetectConfig(config.detect, config.frameSize));
+    d.setPyramidLevel(p.pyramidLevel());
+    Visualizer visualizer(showHand);
+
+    // follows the hand so only the pixels around it are preprocessed. The
+    // region is found by the detect stage and used by the preprocess stage
+    RoiTracker tracker;
+    tracker.setMaxHands(config.maxHands);
+    std::mutex roiMutex;
+    Rect roi;
+
+    // capture, preprocess and detect each run on a thread of their own, and
+    // this thread only draws the frames coming out the end
+    Pipeline pipeline(
+        [&](PipelineFrame& f) {
+            cap >> f.frame;
+            if (f.frame.empty()) {
+                return false;
+            }
+            f.frame.copyTo(f.raw);
+            return true;
+        },
+        [&](PipelineFrame& f) {
+            {
+                std::lock_guard<std::mutex> lock(roiMutex);
+                p.setRegionOfInterest(roi);
+            }
 
-    int frameWidth = 640;
-    int frameHeight = 480;
+            // the mask belongs to p, so the frame keeps a copy of it
+            p(f.frame).copyTo(f.mask);
 
-    // Setup preprocessor and detector
-    Preprocess p(getBackground(cap));
-    Detect d;
+            // keep learning the background everywhere the hand is not
+            bg.update(f.raw, f.mask);
+            if (f.index % backgroundRefresh == 0) {
+                p.setBackground(bg.background());
+            }
+        },
+        [&](PipelineFrame& f) {
+            // finding the contours eats the mask, and the mask is still shown
+            f.mask.copyTo(f.contours);
+
+            // call the detection module, the largest hand is the one that draws
+            f.hands = d.findHands(f.contours);
+            for (size_t i = 0; i < f.hands.size(); ++i) {
+                d.toFullResolution(f.hands[i], f.mask);
+            }
+            if (f.hands.empty()) {
+                f.hand = Hand();
+            }
+            else {
+                f.hand = f.hands[0];
+            }
 
-    Mat frame;
+            // look only around a single hand in the next frame
+            std::lock_guard<std::mutex> lock(roiMutex);
+            roi = tracker.update(f.hand.palm, f.hand.enclosing, f.raw.size());
+        },
+        pipelineCapacity, pipelineDropPolicy);
+
+    // the movies are encoded and written in the background, dropping frames
+    // rather than holding up the main loop when the disk cannot keep up
+    Recorder processedMovie;
+    Recorder detectedMovie;
+    Recorder boardMovie;
+    if (makeMovies) {
+        processedMovie.open(makeVideos ? "processed.avi" : "processed/processed_%03d.jpg");
+        detectedMovie.open(makeVideos ? "detected.avi" : "detected/detected_%03d.jpg");
+        boardMovie.open(makeVideos ? "board.avi" : "board/board_%03d.jpg");
+    }
 
     // variables to draw
     Point prev;
     prev.x = -1;
-    int count = 0;
-    Mat whiteboard = Mat::zeros(frameHeight, frameWidth, CV_32F);
 
-    // the main input loop
+    // the finger doing the drawing keeps its id for as long as it is tracked
+    DrawConfig draw = scaleDrawConfig(config.draw, config.frameSize);
+    TipTracker fingers(draw.tipMaxDistance, tipBirthFrames, tipDeathFrames,
+                       draw.tipDedupeRadius, tipFilterEngine);
+    int drawingFinger = -1;
 
-    while (true) {
-        cap >> frame;
+    // what the hand is doing, pointing draws and an open palm erases or pans
+    GestureRecognizer gestures;
+    Canvas canvas(Size(frameWidth, frameHeight));
+
+    // pick up where an earlier session left off
+    if (!replayLogPath.empty()) {
+        int events = replayStrokes(replayLogPath, canvas);
+        std::cout << replayLogPath << ": " << events << " strokes replayed" << std::endl;
+    }
 
-        Mat raw = frame.clone();
+    // the strokes are logged in board coordinates, timed from the start of the session
+    StrokeLog strokes;
+    if (recordStrokes) {
+        strokes.open(strokeLogPath);
+    }
+    int64 sessionStart = getTickCount();
+
+    // the main output loop, frames arrive in order with the ones the
+    // pipeline dropped left out
+    PipelineFrame* f;
 
-        frame = p(frame);
-        imshow("processed", frame);
+    while (pipeline.next(f)) {
+        int count = f->index;
+        TraceScope trace("render.hand");
+        imshow("processed", f->mask);
 
         // make the processed movie if necessary
-        if(makeMovies) { 
-	        char buffer[20];
-	        sprintf(buffer, "processed/processed_%03d.jpg", count);
-	        imwrite(buffer, frame);
+        if(processedMovie.isOpened()) {
+	        processedMovie.write(f->mask, count);
 	    }
-            
-        // call the detection module
-        std::pair<vector<Point>, std::pair<Point, double>> handInfo = d(frame, raw, count);
+
+        // draw the detected hand, and make its movie if necessary
+        if (visualizer.isEnabled()) {
+            visualizer.draw(f->raw, f->hands);
+            visualizer.show("hand", f->raw);
+
+            if(detectedMovie.isOpened()) {
+	            detectedMovie.write(f->raw, count);
+	        }
+        }
 
         // get where the finger tips are from the detection module
-        vector<Point>& tips = handInfo.first;
-        std::pair<Point, double>& maxCircle = handInfo.second;
+        trace.next("main.gestures");
+        vector<Point>& tips = f->hand.tips;
+        std::pair<Point, double>& maxCircle = f->hand.palm;
+
+        // the milliseconds since the session started, for the stroke log
+        int64 now = (getTickCount() - sessionStart) * 1000 / (int64)getTickFrequency();
+
+        // mirror the hand, and follow each finger tip from the last frame
+        maxCircle.first.x = frameWidth - maxCircle.first.x;
+        for (size_t i = 0; i < tips.size(); ++i) {
+            tips[i].x = frameWidth - tips[i].x;
+        }
+        double captured = f->captureTick / getTickFrequency();
+        fingers.update(tips, captured);
+
+        // opening and closing the hand zooms around it, and a moving open
+        // palm drags the whiteboard along
+        const vector<GestureEvent>& events = gestures.update(gestureFeatures(f->hand, captured));
+        for (size_t i = 0; i < events.size(); ++i) {
+            const GestureEvent& event = events[i];
+            if (event.type == GESTURE_ZOOM && fistZooms) {
+                canvas.zoom(event.scale, Point(cvRound(event.position.x), cvRound(event.position.y)));
+            }
+            else if (event.type == GESTURE_MOVE && event.gesture == GESTURE_OPEN_PALM && palmPans) {
+                canvas.pan(Point2f(-event.delta.x, -event.delta.y));
+            }
+        }
+
+        // an open palm erases what Detect takes to be the hand, unless it pans
+        // (the hand is in view coordinates, the canvas maps them onto the board)
+        if(gestures.active() == GESTURE_OPEN_PALM && !palmPans && maxCircle.second > 0) {
+            Point center = canvas.toBoard(maxCircle.first);
+            int radius = cvRound(canvas.toBoard(config.detect.regionRadii * maxCircle.second));
+            canvas.erase(center, radius);
 
-        // all five fingers are present, so erase
-        if(tips.size() >= 10) {
-            maxCircle.first.x = frameWidth - maxCircle.first.x;
-            circle(whiteboard, maxCircle.first, 3.5*maxCircle.second, Scalar(0, 0, 0), -1);
+            if (strokes.isOpened()) {
+                strokes.erase(center, radius, now);
+            }
         }
 
-        // else, draw the first finger
-        else if(tips.size() > 0) {
-            if(prev.x != -1) {
-                tips[0].x = frameWidth - tips[0].x;
-                if(d.euclideanDist(prev, tips[0]) < 200)
-                    line(whiteboard, prev, tips[0], Scalar(255, 255, 255), 3);
+        // a pointing hand draws, with the same finger as in the last frame, or
+        // with the finger tracked longest once that one is gone
+        else if(gestures.active() == GESTURE_POINT) {
+            const TipTrack* finger = fingers.find(drawingFinger);
+            if (!finger) {
+                finger = fingers.oldest();
+            }
+
+            // a new finger starts a new stroke
+            if (!finger || finger->id != drawingFinger) {
+                prev.x = -1;
+                drawingFinger = finger ? finger->id : -1;
+            }
+
+            // a finger missed in this frame is only kept in mind, not drawn
+            if (finger && finger->misses == 0) {
+                // move the smoothed tip on by the time its frame spent in the pipeline
+                double latency = (getTickCount() - f->captureTick) / getTickFrequency();
+                Point2f filtered = predictTips ? finger->filter.predict(latency) : finger->filter.position();
+                Point tip(cvRound(filtered.x), cvRound(filtered.y));
+
+                if(prev.x != -1) {
+                    if(d.euclideanDist(prev, tip) < draw.strokeBreak) {
+                        Point from = canvas.toBoard(prev);
+                        Point to = canvas.toBoard(tip);
+                        canvas.line(from, to, 3);
+
+                        if (strokes.isOpened()) {
+                            strokes.line(from, to, 3, now);
+                        }
+                    }
+                }
+                prev = tip;
             }
-            prev = tips[0];
         }
 
-        
+        // any other gesture ends the stroke
+        else {
+            prev.x = -1;
+        }
+
+        // only the tiles drawn on since the last frame are copied into the view
+        trace.next("render.board");
+        const Mat& whiteboard = canvas.render();
         imshow("HandMade", whiteboard);
 
         // output the board movie (if the flag is set)
-        if(makeMovies) {
-	        char buffer2[20];
-	        sprintf(buffer2, "board/board_%03d.jpg", count);
-			imwrite(buffer2, whiteboard);
+        if(boardMovie.isOpened()) {
+	        boardMovie.write(whiteboard, count);
     	}
 
-        keyboardHandler();
+        pipeline.release(f);
 
-        ++count;
+        if (traceStages && count > 0 && count % traceSummaryFrames == 0) {
+            printTraceSummary(std::cout);
+        }
+
+        // highgui paints its windows while it waits for a key
+        trace.next("render.wait");
+
+        if (!keyboardHandler(canvas, whiteboard.size())) {
+            break;
+        }
     }
-}
 
+    pipeline.stop();
+    destroyAllWindows();
+
+    if (traceStages && !traceFile.empty()) {
+        if (writeChromeTrace(traceFile)) {
+            std::cout << traceFile << ": trace written" << std::endl;
+        }
+        else {
+            std::cerr << traceFile << ": could not write the trace" << std::endl;
+        }
+    }
+
+    if (strokes.isOpened()) {
+        strokes.close();
+        std::cout << strokeLogPath << ": " << strokes.bytes() << " bytes of strokes" << std::endl;
+    }
+
+    // finish writing the movies and say how much of them made it
+    Recorder* movies[] = { &processedMovie, &detectedMovie, &boardMovie };
+    const char* names[] = { "processed", "detected", "board" };
+    for (int i = 0; i < 3; ++i) {
+        if (movies[i]->isOpened()) {
+            movies[i]->close();
+            std::cout << names[i] << ": " << movies[i]->written() << " frames written, "
+                      << movies[i]->dropped() << " dropped" << std::endl;
+        }
+    }
+    return 0;
+}
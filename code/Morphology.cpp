@@ -0,0 +1,253 @@
+#include "Morphology.h"
+
+#include <algorithm>
+
+// the fewest rows worth giving a stripe of their own, so the halo stays a
+// small part of the work
+static const int MIN_STRIPE_ROWS = 32;
+
+/**
+ * the smaller and the larger of two pixels
+ */
+
+struct MinOp
+{
+    static uchar apply(uchar a, uchar b) { return a < b ? a : b; }
+};
+
+struct MaxOp
+{
+    static uchar apply(uchar a, uchar b) { return a > b ? a : b; }
+};
+
+/**
+ * the running min or max, by Op, of every window of k pixels of line, where
+ * line holds n pixels and n is a multiple of k
+ *
+ * This is van Herk/Gil-Werman: the line is cut into blocks of k, and within
+ * every block suffix holds the min from each pixel to the end of the block
+ * and line, in place, the min from the start of the block to each pixel. A
+ * window of k pixels starting at x covers the end of one block and the start
+ * of the next, so its min is min(suffix[x], line[x + k - 1]), which is left
+ * in out for every x below count
+ */
+
+template <class Op>
+static void runningRow(uchar* line, uchar* suffix, int n, int k, uchar* out, int count)
+{
+    for (int start = 0; start < n; start += k) {
+        int end = start + k - 1;
+
+        suffix[end] = line[end];
+        for (int i = end - 1; i >= start; --i) {
+            suffix[i] = Op::apply(suffix[i + 1], line[i]);
+        }
+        for (int i = start + 1; i <= end; ++i) {
+            line[i] = Op::apply(line[i - 1], line[i]);
+        }
+    }
+
+    for (int x = 0; x < count; ++x) {
+        out[x] = Op::apply(suffix[x], line[x + k - 1]);
+    }
+}
+
+/**
+ * one pass of the open, an erosion or a dilation of every stripe of every
+ * plane
+ *
+ * Pixels outside of a plane count as 255 for the erosion and 0 for the
+ * dilation, so they never win, which is the border morphologyEx uses
+ */
+
+template <class Op>
+class SquarePass : public ParallelLoopBody
+{
+    private:
+        const Mat* _src;
+        Mat* _dst;
+        std::vector<Mat>& _scratch;
+        const int _stripes;
+        const int _size;
+        const uchar _border;
+
+    public:
+        SquarePass(const Mat* src, Mat* dst, std::vector<Mat>& scratch,
+                   int stripes, int size, uchar border) :
+            _src(src),
+            _dst(dst),
+            _scratch(scratch),
+            _stripes(stripes),
+            _size(size),
+            _border(border)
+        {}
+
+        void operator()(const Range& range) const
+        {
+            for (int task = range.start; task < range.end; ++task) {
+                stripe(task);
+            }
+        }
+
+        /**
+         * filters the rows of one stripe of one plane
+         *
+         * The rows of the stripe and its halo are first filtered along the
+         * rows into the top of the buffer, and then along the columns, where
+         * the blocks of van Herk/Gil-Werman are blocks of whole rows and the
+         * bottom of the buffer holds their suffixes
+         */
+
+        void stripe(int task) const
+        {
+            const Mat& src = _src[task / _stripes];
+            Mat& dst = _dst[task / _stripes];
+            int part = task % _stripes;
+
+            int k = _size;
+            int r = k / 2;
+            int cols = src.cols;
+            int first = src.rows * part / _stripes;
+            int last = src.rows * (part + 1) / _stripes;
+
+            // the stripe with its halo, and a row of pixels with its border,
+            // both rounded up to whole blocks
+            int rows = (last - first + 2 * r + k - 1) / k * k;
+            int width = (cols + 2 * r + k - 1) / k * k;
+
+            Mat& scratch = _scratch[task];
+            scratch.create(2 * rows + 2, width, CV_8U);
+            uchar* line = scratch.ptr(2 * rows);
+            uchar* lineSuffix = scratch.ptr(2 * rows + 1);
+
+            // along the rows, a row outside the plane is all border
+            for (int j = 0; j < rows; ++j) {
+                int y = first - r + j;
+                uchar* out = scratch.ptr(j);
+
+                if (y < 0 || y >= src.rows) {
+                    std::fill(out, out + cols, _border);
+                    continue;
+                }
+
+                const uchar* in = src.ptr(y);
+                std::fill(line, line + r, _border);
+                std::copy(in, in + cols, line + r);
+                std::fill(line + r + cols, line + width, _border);
+
+                runningRow<Op>(line, lineSuffix, width, k, out, cols);
+            }
+
+            // along the columns, a block of k rows at a time
+            for (int start = 0; start < rows; start += k) {
+                int end = start + k - 1;
+
+                std::copy(scratch.ptr(end), scratch.ptr(end) + cols, scratch.ptr(rows + end));
+                for (int j = end - 1; j >= start; --j) {
+                    const uchar* below = scratch.ptr(rows + j + 1);
+                    const uchar* in = scratch.ptr(j);
+                    uchar* suffix = scratch.ptr(rows + j);
+                    for (int x = 0; x < cols; ++x) {
+                        suffix[x] = Op::apply(below[x], in[x]);
+                    }
+                }
+                for (int j = start + 1; j <= end; ++j) {
+                    const uchar* above = scratch.ptr(j - 1);
+                    uchar* prefix = scratch.ptr(j);
+                    for (int x = 0; x < cols; ++x) {
+                        prefix[x] = Op::apply(above[x], prefix[x]);
+                    }
+                }
+            }
+
+            for (int y = first; y < last; ++y) {
+                const uchar* suffix = scratch.ptr(rows + y - first);
+                const uchar* prefix = scratch.ptr(y - first + k - 1);
+                uchar* out = dst.ptr(y);
+                for (int x = 0; x < cols; ++x) {
+                    out[x] = Op::apply(suffix[x], prefix[x]);
+                }
+            }
+        }
+};
+
+/**
+ * The constructor for SquareOpen
+ *
+ * size is the side of the square, and has to be odd. The default of 7 is
+ * what three iterations of a 3x3 open come to
+ */
+
+SquareOpen::SquareOpen(int size) :
+    _size(size | 1)
+{}
+
+/**
+ * The destructor for SquareOpen
+ *
+ * As of now this does nothing
+ */
+
+SquareOpen::~SquareOpen()
+{}
+
+/**
+ * Returns how many stripes every plane is cut into
+ *
+ * There is one task for every thread OpenCV runs, spread over the planes,
+ * but no stripe is made thinner than MIN_STRIPE_ROWS
+ */
+
+int SquareOpen::stripes(int count, int rows) const
+{
+    int threads = std::max(1, getNumThreads());
+    int wanted = (threads + count - 1) / count;
+    int most = std::max(1, rows / MIN_STRIPE_ROWS);
+    return std::min(wanted, most);
+}
+
+/**
+ * Opens the planes given, which have to be 8 bit and single channel, in
+ * place
+ *
+ * The erosion of every stripe runs first, into _eroded, and only once all of
+ * them are done does the dilation read them back, since a stripe's halo is
+ * made of its neighbours' rows
+ */
+
+void SquareOpen::operator()(Mat planes[], int count)
+{
+    if (count <= 0 || _size <= 1) {
+        return;
+    }
+
+    int rows = planes[0].rows;
+    for (int i = 1; i < count; ++i) {
+        rows = std::min(rows, planes[i].rows);
+    }
+    int perPlane = stripes(count, rows);
+    int tasks = count * perPlane;
+
+    if ((int)_eroded.size() < count) {
+        _eroded.resize(count);
+    }
+    if ((int)_scratch.size() < tasks) {
+        _scratch.resize(tasks);
+    }
+    for (int i = 0; i < count; ++i) {
+        CV_Assert(planes[i].type() == CV_8UC1);
+        _eroded[i].create(planes[i].size(), CV_8U);
+    }
+
+    parallel_for_(Range(0, tasks), SquarePass<MinOp>(planes, &_eroded[0], _scratch, perPlane, _size, 255));
+    parallel_for_(Range(0, tasks), SquarePass<MaxOp>(&_eroded[0], planes, _scratch, perPlane, _size, 0));
+}
+
+/**
+ * Returns the side of the square
+ */
+
+int SquareOpen::size() const
+{
+    return _size;
+}
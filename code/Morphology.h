@@ -0,0 +1,58 @@
+#ifndef MORPHOLOGY_H
+#define MORPHOLOGY_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+using namespace cv;
+
+/**
+ * The SquareOpen class
+ *
+ * This opens binary (or gray) 8 bit planes with a square structuring
+ * element, giving exactly what morphologyEx with MORPH_OPEN, a 3x3 MORPH_RECT
+ * element and (size - 1) / 2 iterations gives, borders included
+ *
+ * A square is the same as a row followed by a column, so the erosion and the
+ * dilation are each done as a running min or max along the rows and then
+ * along the columns. The running min and max use the van Herk/Gil-Werman
+ * algorithm, which takes three comparisons per pixel whatever the size of
+ * the square. Every plane is cut into stripes of rows, and all the stripes of
+ * all the planes are run in parallel. A stripe reads the (size - 1) / 2 rows
+ * above and below it as a halo, so the stripes never wait on each other, and
+ * it works in a buffer of its own that is kept between calls, so once the
+ * first call has sized them no image is allocated
+ */
+
+class SquareOpen
+{
+    private:
+        // the side of the square, odd
+        const int _size;
+
+        // the eroded planes, which the dilation reads
+        std::vector<Mat> _eroded;
+
+        // the buffer of every stripe of every plane
+        std::vector<Mat> _scratch;
+
+        // the stripes each plane is cut into for planes of the size given
+        int stripes(int count, int rows) const;
+
+    public:
+        SquareOpen(int size = 7);
+        ~SquareOpen();
+
+        // opens the planes given in place
+        void operator()(Mat planes[], int count);
+
+        // the side of the square
+        int size() const;
+};
+
+#endif // MORPHOLOGY_H
@@ -0,0 +1,178 @@
+#include "Pipeline.h"
+
+/**
+ * The constructor for Pipeline
+ *
+ * Takes the three stages and starts a thread for each. capacity is how many
+ * frames can wait between two stages, and policy is what happens when a
+ * stage falls further behind than that
+ *
+ * Every queue can be full, every stage thread and the caller can hold a
+ * frame, and that is all the frames there will ever be
+ */
+
+Pipeline::Pipeline(const Capture& capture, const Stage& preprocess, const Stage& detect,
+                   size_t capacity, DropPolicy policy) :
+    _capture(capture),
+    _preprocess(preprocess),
+    _detect(detect),
+    _frames(3 * std::max<size_t>(1, capacity) + 4),
+    _free(_frames.size()),
+    _toPreprocess(capacity, policy),
+    _toDetect(capacity, policy),
+    _done(capacity, policy),
+    _captured(0),
+    _dropped(0)
+{
+    PipelineFrame* unused;
+    for (size_t i = 0; i < _frames.size(); ++i) {
+        _free.push(&_frames[i], unused);
+    }
+
+    _captureThread = std::thread(&Pipeline::captureLoop, this);
+    _preprocessThread = std::thread(&Pipeline::stageLoop, this,
+                                    std::ref(_toPreprocess), std::ref(_toDetect), std::cref(_preprocess));
+    _detectThread = std::thread(&Pipeline::stageLoop, this,
+                                std::ref(_toDetect), std::ref(_done), std::cref(_detect));
+}
+
+/**
+ * The destructor for Pipeline
+ *
+ * Stops the stages and waits for their threads
+ */
+
+Pipeline::~Pipeline()
+{
+    stop();
+}
+
+/**
+ * The capture thread
+ *
+ * Captures into free frames until the capture stage fails, then closes the
+ * first queue so the stages after it finish what is left and stop too
+ */
+
+void Pipeline::captureLoop()
+{
+    PipelineFrame* frame;
+
+    while (_free.pop(frame)) {
+        frame->index = _captured;
+        if (!_capture(*frame)) {
+            break;
+        }
+
+        frame->captureTick = getTickCount();
+        ++_captured;
+        forward(_toPreprocess, frame);
+    }
+
+    _toPreprocess.close();
+}
+
+/**
+ * A stage thread
+ *
+ * Runs the stage on every frame coming in and passes it on, closing the
+ * queue out once the queue in is closed and empty
+ */
+
+void Pipeline::stageLoop(BoundedQueue<PipelineFrame*>& in,
+                         BoundedQueue<PipelineFrame*>& out,
+                         const Stage& stage)
+{
+    PipelineFrame* frame;
+
+    while (in.pop(frame)) {
+        stage(*frame);
+        forward(out, frame);
+    }
+
+    out.close();
+}
+
+/**
+ * Pushes a frame onto the next queue
+ *
+ * A frame the queue drops, or the frame itself if the queue was closed, goes
+ * back to the free frames
+ */
+
+void Pipeline::forward(BoundedQueue<PipelineFrame*>& queue, PipelineFrame* frame)
+{
+    PipelineFrame* rejected;
+    if (queue.push(frame, rejected)) {
+        if (rejected != frame) {
+            ++_dropped;
+        }
+
+        PipelineFrame* unused;
+        _free.push(rejected, unused);
+    }
+}
+
+/**
+ * Waits for the next frame that made it through detection
+ *
+ * The frame belongs to the caller until it is handed back with release
+ */
+
+bool Pipeline::next(PipelineFrame*& frame)
+{
+    return _done.pop(frame);
+}
+
+/**
+ * Hands a frame from next back to the capture stage
+ */
+
+void Pipeline::release(PipelineFrame* frame)
+{
+    PipelineFrame* unused;
+    _free.push(frame, unused);
+}
+
+/**
+ * Stops every stage and waits for their threads
+ *
+ * Nothing more is captured or handed out by next. The stages finish the
+ * frames already waiting for them, but those frames go nowhere
+ */
+
+void Pipeline::stop()
+{
+    _free.close();
+    _toPreprocess.close();
+    _toDetect.close();
+    _done.close();
+
+    if (_captureThread.joinable()) {
+        _captureThread.join();
+    }
+    if (_preprocessThread.joinable()) {
+        _preprocessThread.join();
+    }
+    if (_detectThread.joinable()) {
+        _detectThread.join();
+    }
+}
+
+/**
+ * Returns the number of frames captured so far
+ */
+
+int Pipeline::captured() const
+{
+    return _captured;
+}
+
+/**
+ * Returns the number of frames the queues have dropped so far
+ */
+
+int Pipeline::dropped() const
+{
+    return _dropped;
+}
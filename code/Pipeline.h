@@ -0,0 +1,124 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "BoundedQueue.h"
+#include "Detect.h"
+
+using namespace cv;
+
+/**
+ * A frame on its way through the Pipeline
+ *
+ * Frames are recycled once the caller is done with them, so every Mat here
+ * keeps its buffer and stages should write into them with copyTo or as an
+ * OpenCV output rather than assigning new images
+ */
+
+struct PipelineFrame
+{
+    // the number of the frame, counting from zero at the capture
+    int index;
+
+    // getTickCount when the frame was captured, to measure the latency by
+    int64 captureTick;
+
+    // the captured frame, and a copy of it to draw the hand on
+    Mat frame;
+    Mat raw;
+
+    // the preprocessed hand mask, at the pyramid level Preprocess works at,
+    // and a copy of it for Detect to consume
+    Mat mask;
+    Mat contours;
+
+    // every hand Detect found, largest first, and the largest on its own
+    vector<Hand> hands;
+    Hand hand;
+};
+
+/**
+ * The Pipeline class
+ *
+ * This runs capture, preprocessing and detection on a thread each, so a new
+ * frame is captured while the last one is preprocessed and the one before
+ * that is detected. Rendering stays with the caller (highgui only works from
+ * the main thread), which takes finished frames with next and hands them
+ * back with release
+ *
+ * The stages are connected by bounded queues. Frames always come out in the
+ * order they were captured, and with DROP_OLDEST a stage that falls behind
+ * loses its oldest waiting frames instead of holding up the camera. A fixed
+ * set of frames circulates through the queues, so after the first lap no
+ * stage allocates a frame
+ */
+
+class Pipeline
+{
+    public:
+        // fills in the frame, the capture stage returns false when there are no more
+        typedef std::function<bool(PipelineFrame&)> Capture;
+        typedef std::function<void(PipelineFrame&)> Stage;
+
+    private:
+        Capture _capture;
+        Stage _preprocess;
+        Stage _detect;
+
+        std::vector<PipelineFrame> _frames;
+
+        // the unused frames, and the queues between the stages
+        BoundedQueue<PipelineFrame*> _free;
+        BoundedQueue<PipelineFrame*> _toPreprocess;
+        BoundedQueue<PipelineFrame*> _toDetect;
+        BoundedQueue<PipelineFrame*> _done;
+
+        std::atomic<int> _captured;
+        std::atomic<int> _dropped;
+
+        std::thread _captureThread;
+        std::thread _preprocessThread;
+        std::thread _detectThread;
+
+        // the capture thread, filling free frames until the capture runs dry
+        void captureLoop();
+
+        // a stage thread, running the stage on every frame between the queues
+        void stageLoop(BoundedQueue<PipelineFrame*>&, BoundedQueue<PipelineFrame*>&, const Stage&);
+
+        // pushes the frame onward, recycling whatever the queue drops or refuses
+        void forward(BoundedQueue<PipelineFrame*>&, PipelineFrame*);
+
+    public:
+        Pipeline(const Capture& capture, const Stage& preprocess, const Stage& detect,
+                 size_t capacity = 2, DropPolicy policy = DROP_OLDEST);
+        ~Pipeline();
+
+        // waits for the next detected frame, false once the capture has ended
+        bool next(PipelineFrame*& frame);
+
+        // hands a frame from next back to be captured into again
+        void release(PipelineFrame* frame);
+
+        // stops every stage, frames still in flight are never handed out
+        void stop();
+
+        // the number of frames captured so far
+        int captured() const;
+
+        // the number of frames dropped by the queues so far
+        int dropped() const;
+};
+
+#endif // PIPELINE_H
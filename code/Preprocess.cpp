@@ -1,21 +1,84 @@
 #include "Preprocess.h"
+#include "Segment.h"
+#include "Trace.h"
+
+/**
+ * Thresholds the channels given with Otsu's method, each on a thread of its
+ * own, skipping the ones with a fixed threshold
+ */
+
+class OtsuThreshold : public ParallelLoopBody
+{
+    private:
+        Mat* _planes;
+        const Scalar& _thresholds;
+
+    public:
+        OtsuThreshold(Mat planes[3], const Scalar& thresholds) :
+            _planes(planes),
+            _thresholds(thresholds)
+        {}
+
+        void operator()(const Range& range) const
+        {
+            for (int i = range.start; i < range.end; ++i) {
+                if (_thresholds[i] < 0) {
+                    threshold(_planes[i], _planes[i], 0, 255, THRESH_BINARY | THRESH_OTSU);
+                }
+            }
+        }
+};
+
+/**
+ * returns the side of the open the iterations of a 3x3 open add up to at a
+ * pyramid level, a pixel smaller each side for every level down
+ */
+
+static int openSize(int iterations, int level)
+{
+    return std::max(1, 2 * (iterations - level) + 1);
+}
+
+/**
+ * The constructor for PreprocessConfig
+ *
+ * The constants Preprocess was tuned with
+ */
+
+PreprocessConfig::PreprocessConfig() :
+    minYCrCb(0, 133, 77),
+    maxYCrCb(255, 173, 127),
+    blurSize(7),
+    blurSigma(1.8),
+    openIterations(3),
+    channelThresholds(Scalar::all(-1))
+{}
 
 /**
  * The constructor for Preprocess
  *
- * Only takes in a Mat representing the background
+ * Takes in a Mat representing the background, the face cascade, an empty
+ * one to black out no faces, and how to segment the hand
  *
- * Note that we do not attempt to find the background dynamically
- * Rather, we initialize the background before hand and rely on that throughout
- * the code
+ * The background is not tracked here. It comes from the Background model,
+ * which hands over updates through setBackground
  */
 
-Preprocess::Preprocess(const Mat& bg) :
-    _bg(bg),
-    min_YCrCb(Scalar(0, 133, 77)),
-    max_YCrCb(Scalar(255, 173, 127))
+Preprocess::Preprocess(const Mat& bg, const std::string& cascade, const PreprocessConfig& config) :
+    _baseBlur(config.blurSize | 1),
+    _baseSigma(config.blurSigma),
+    _level(0),
+    _blur(_baseBlur),
+    _sigma(_baseSigma),
+    min_YCrCb(config.minYCrCb),
+    max_YCrCb(config.maxYCrCb),
+    _channelThresholds(config.channelThresholds),
+    face_tracker(cascade),
+    _open{SquareOpen(openSize(config.openIterations, 0)),
+          SquareOpen(openSize(config.openIterations, 1)),
+          SquareOpen(openSize(config.openIterations, 2))}
 {
-   if( !face_cascade.load( "frontal_face.xml" ) ){ printf("--(!)Error loading\n");};
+   setBackground(bg);
 }
 
 /**
@@ -28,108 +91,222 @@ Preprocess::~Preprocess()
 {}
 
 /**
- * Thresholds the image and filters out noise
- * This function assumes that the frame passed in is of YCrCb values
+ * Replaces the background used for background subtraction
  *
- * We accomplish this by using Otus's method on each of the three channels and
- * then running pixel erosion and dilation morphologyEx on them as well
+ * Every frame is blurred before the background is subtracted from it, so the
+ * background has to be blurred the same way. Doing it here means it happens
+ * once per background rather than once per frame, and the stored background
+ * never gets blurred more than once
+ *
+ * The background is taken down to the pyramid level the same way too, and
+ * a copy of it is kept as it was given, for when the level changes
  */
 
-Mat Preprocess::thresholdFilter(Mat& frame)
+void Preprocess::setBackground(const Mat& bg)
 {
-    Mat frameChannels[3];
-    split(frame, frameChannels);
-
-    // Chooses how we erode and dilate
-    Mat element = getStructuringElement(MORPH_RECT, Size(3, 3));
+    bg.copyTo(_background);
 
-    for (int i = 0; i < 3; i++) {
-        // Applies a threshold using Otsu's method
-        threshold(frameChannels[i], frameChannels[i], 0, 255, THRESH_BINARY | THRESH_OTSU);
-
-        // Runs pixel erosion and dilation for three iterations
-        morphologyEx(frameChannels[i], frameChannels[i], MORPH_OPEN, element, Point(-1, -1), 3);
+    Mat level = _background;
+    for (int i = 0; i < _level; ++i) {
+        Mat down;
+        pyrDown(level, down);
+        level = down;
     }
+    GaussianBlur(level, _bg, Size(_blur, _blur), _sigma, _sigma);
+}
 
-    // Merge the channels back together
-    Mat merged;
-    merge(frameChannels, 3, merged);
+/**
+ * Restricts the processing of later frames to the rectangle given
+ *
+ * Everything outside of it is left black in the output, so callers like the
+ * RoiTracker should pad the rectangle around the hand. An empty rectangle
+ * goes back to processing the full frame
+ */
 
-    return merged;
+void Preprocess::setRegionOfInterest(const Rect& roi)
+{
+    _roi = roi;
 }
 
 /**
- * The main interface to the Preprocess class
- * 
- * This takes in an image, most likely a frame from a video and preprocesses that image 
- * and outputs a binary image (hopefully) containing only the hand
+ * Processes later frames at a pyramid level of their own
  *
- * We accomplish this by a mix of procedures, 
- * such as thresholding, bitwise and, pixel erosion and dilation, and more
- *
- * A description of why each method was selected is provided in our report, as well as it's inspiration
+ * At level 1 the frame is taken down to half its resolution with pyrDown
+ * before anything else is done with it, and at level 2 to a quarter, so
+ * every later pass (and Detect after it) touches a quarter or a sixteenth of
+ * the pixels. The blurs shrink with the level, so they cover about as much
+ * of the hand as they do at full resolution. The open shrinks less, from
+ * 7x7 to 5x5 and 3x3, since pyrDown leaves the speckles of camera noise
+ * larger next to a pixel than they were, and a square halved with the level
+ * lets them through. The mask comes out at the level, the size of the frame
+ * halved once per level and rounded up. The region of interest and the faces
+ * stay in full resolution coordinates. Levels outside of 0 to 2 are clamped
  */
 
-Mat Preprocess::operator() (Mat& frame)
+void Preprocess::setPyramidLevel(int level)
 {
-	// detect faces
-    vector<Rect> faces = faceDetection(frame);
+    _level = std::max(0, std::min(level, 2));
 
-	cvtColor(frame, frame, CV_BGR2YCrCb);
+    // by default a 7x7 blur with a sigma of 1.8 at full resolution, 5x5 at half and 3x3 at a quarter
+    _blur = 2 * std::max(1, cvRound((_baseBlur / 2) / (double)(1 << _level))) + 1;
+    _sigma = _baseSigma / (1 << _level);
 
-    // Copy the raw image for debugging purposes
-    Mat raw = frame.clone();
+    setBackground(_background.clone());
+}
 
-    GaussianBlur(_bg, _bg, Size(7,7), 1.8, 1.8);
-    GaussianBlur(frame, frame, Size(7,7), 1.8, 1.8);
+/**
+ * Returns the pyramid level frames are processed at, 0 for full resolution
+ */
 
-    frame = frame - _bg;
+int Preprocess::pyramidLevel() const
+{
+    return _level;
+}
 
-    frame = thresholdFilter(frame);
+/**
+ * Sets the threshold used on each channel of the background difference
+ *
+ * A negative threshold, the default, picks it with Otsu's method on every
+ * frame. Fixed thresholds skip the histogram and are applied in the same pass
+ * as the background subtraction
+ */
 
-    // Run another pixel erosion and dilation on this function
-    Mat element = getStructuringElement(MORPH_RECT, Size(3, 3));
-    morphologyEx(frame, frame, MORPH_OPEN, element, Point(-1, -1), 3);
+void Preprocess::setChannelThresholds(const Scalar& thresholds)
+{
+    _channelThresholds = thresholds;
+}
+
+/**
+ * Thresholds the channels and filters out noise
+ * This function assumes that the planes passed in are the channels of a
+ * YCrCb background difference
+ *
+ * We accomplish this by using Otus's method on each of the three channels
+ * (unless it has a fixed threshold, in which case thresholdDifference has
+ * already applied it) and then running pixel erosion and dilation on them as
+ * well
+ *
+ * The channels are independent, so the three thresholds run in parallel.
+ * The erosion and dilation used to be morphologyEx with a 3x3 element and
+ * three iterations (the default openIterations), which is the same as a
+ * single open with a 7x7 square.
+ * SquareOpen does that open separably, striping every channel across the
+ * threads, and gives exactly the same planes
+ */
 
-    // And the thresholded image with the original
-    bitwise_and(frame, raw, frame);
+void Preprocess::thresholdFilter(Mat planes[3])
+{
+    parallel_for_(Range(0, 3), OtsuThreshold(planes, _channelThresholds));
 
-    // Convert the frame to grayscale
-    cvtColor(frame, frame, CV_YCrCb2BGR);
-    cvtColor(frame, frame, CV_BGR2GRAY);
+    // Runs pixel erosion and dilation for the iterations of the config
+    _open[_level](planes, 3);
+}
 
-    // Threshold the grayscaled image with Otsu once more
-    threshold(frame, frame, 120, 255, THRESH_BINARY_INV);
+/**
+ * The main interface to the Preprocess class
+ * 
+ * This takes in an image, most likely a frame from a video and preprocesses that image 
+ * and outputs a binary image (hopefully) containing only the hand
+ *
+ * We accomplish this by a mix of procedures, 
+ * such as thresholding, bitwise and, pixel erosion and dilation, and more
+ *
+ * A description of why each method was selected is provided in our report, as well as it's inspiration
+ *
+ * Every intermediate image is a member, and the returned mask is too, so once
+ * the first frame (or a new region of interest size) has sized them none of
+ * them is allocated again. The blurs and the pyramid still allocate scratch
+ * of their own inside OpenCV. The frame passed in is left untouched
+ */
 
-    // Skin extraction from our member variables
-    Mat skinRegion; 
-    inRange(raw, min_YCrCb, max_YCrCb, skinRegion);
+const Mat& Preprocess::operator() (const Mat& frame)
+{
+    // only look at the region of interest, which may be the whole frame
+    Rect full(0, 0, frame.cols, frame.rows);
+    Rect roi = _roi.area() > 0 ? _roi & full : full;
+
+    // widen the region to whole pixels of the pyramid level, and find both
+    // at the level
+    int scale = 1 << _level;
+    roi = Rect(Point(roi.x & -scale, roi.y & -scale),
+               Point(std::min(frame.cols, (roi.br().x + scale - 1) & -scale),
+                     std::min(frame.rows, (roi.br().y + scale - 1) & -scale)));
+    Rect levelFull(0, 0, _bg.cols, _bg.rows);
+    Rect levelRoi(roi.x / scale, roi.y / scale,
+                  (roi.width + scale - 1) / scale, (roi.height + scale - 1) / scale);
+
+	// detect faces on the whole frame, the tracker keeps them up to date
+    TraceScope trace("preprocess.faces");
+    const vector<Rect>& faces = faceDetection(frame);
+
+    // take the region down to the pyramid level
+    trace.next("preprocess.pyramid");
+    Mat region = frame(roi);
+    for (int i = 0; i < _level; ++i) {
+        pyrDown(region, _levels[i]);
+        region = _levels[i];
+    }
 
-    compare(frame, skinRegion, frame, CMP_EQ);
+    // converting into a separate Mat keeps the blur from reading outside the region
+    trace.next("preprocess.blur");
+	cvtColor(region, _ycrcb, CV_BGR2YCrCb);
 
-    // draw a black rectange over each face.
+    // Copy the raw image for debugging purposes
+    _ycrcb.copyTo(_raw);
+
+    GaussianBlur(_ycrcb, _ycrcb, Size(_blur, _blur), _sigma, _sigma);
+
+    // Subtract the background (_bg is already blurred, so this only reads it,
+    // and is kept in BGR, so its channels are taken from the YCrCb ones)
+    // and split the difference into one plane per channel, thresholded
+    // straight away where the threshold is fixed
+    trace.next("preprocess.difference");
+    thresholdDifference(_ycrcb, _bg(levelRoi), _channelThresholds, _planes);
+
+    // An open is idempotent, opening the planes a second time with the same
+    // element changes nothing, so the second round of erosion and dilation
+    // that used to follow this is gone
+    trace.next("preprocess.threshold");
+    thresholdFilter(_planes);
+
+    // And the channels with the original, convert to grayscale, threshold it
+    // at 120 and compare with the skin range of our member variables, all in
+    // one pass
+    trace.next("preprocess.skin");
+    skinMask(_planes, _raw, min_YCrCb, max_YCrCb, _mask);
+
+    // draw a black rectange over each face, rounded outwards to the level
     for(int i = 0; i < faces.size(); i++) {
-        rectangle(frame, faces[i], Scalar(0, 0, 0), -1, 0, 0);
+        Rect face(Point(faces[i].x / scale, faces[i].y / scale),
+                  Point((faces[i].br().x + scale - 1) / scale, (faces[i].br().y + scale - 1) / scale));
+        rectangle(_mask, face - levelRoi.tl(), Scalar(0, 0, 0), -1, 0, 0);
     }
 
-    // Finally run a GaussianFilter
-    GaussianBlur(frame, frame, Size(7,7), 1.8, 1.8);
+    // put the region back in place in an otherwise black frame, blurring it
+    // straight into the output when it is the whole frame
+    trace.next("preprocess.output");
+    if (levelRoi == levelFull) {
+        GaussianBlur(_mask, _output, Size(_blur, _blur), _sigma, _sigma);
+    }
+    else {
+        _output.create(levelFull.size(), CV_8U);
+        _output.setTo(Scalar::all(0));
+
+        Mat target = _output(levelRoi);
+        GaussianBlur(_mask, target, Size(_blur, _blur), _sigma, _sigma);
+    }
 
-    return frame;
+    return _output;
 }
 
 /**
- * Finds faces using detectMultiScale
+ * Finds faces using the FaceTracker
  * Returns a vector of Rects representing location and size of face.
+ *
+ * The cascade itself runs every few frames on a worker thread, so these are
+ * the faces of the latest detection moved along to this frame
  */
 
-vector<Rect> Preprocess::faceDetection(Mat& frame) {
-    vector<Rect> faces;
-    Mat frame_gray;
-    cvtColor( frame, frame_gray, CV_BGR2GRAY );
-
-    face_cascade.detectMultiScale( frame_gray, faces, 1.3, 2, 0|CV_HAAR_SCALE_IMAGE, Size(30, 30));
-
-    return faces;
+const vector<Rect>& Preprocess::faceDetection(const Mat& frame) {
+    return face_tracker(frame);
 }
-
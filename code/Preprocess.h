@@ -9,6 +9,9 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv/cv.h>
 
+#include "FaceTracker.h"
+#include "Morphology.h"
+
 /** 
  * The Preprocessing class
  *
@@ -24,28 +27,100 @@
 
 using namespace cv;
 
+/**
+ * How Preprocess segments the hand
+ *
+ * The defaults are the constants Preprocess always used. The blur and the
+ * open are given at full resolution, and shrink with the pyramid level
+ */
+
+struct PreprocessConfig
+{
+    // the YCrCb range skin falls in
+    Scalar minYCrCb;
+    Scalar maxYCrCb;
+
+    // the side and sigma of the gaussian blurs of the frame and the mask
+    int blurSize;
+    double blurSigma;
+
+    // how many times the channels are eroded and dilated with a 3x3 square
+    int openIterations;
+
+    // the threshold of each channel of the background difference, negative for Otsu
+    Scalar channelThresholds;
+
+    PreprocessConfig();
+};
+
 class Preprocess
 {
     private:
+        // the background as it was given, and at the pyramid level, already
+        // blurred the same way each frame is
+        Mat _background;
         Mat _bg;
+
+        // the side and sigma of the blurs at full resolution
+        const int _baseBlur;
+        const double _baseSigma;
+
+        // the pyramid level the frame is processed at, 0 for full resolution,
+        // 1 for half and 2 for a quarter, and the side and sigma of the blurs at it
+        int _level;
+        int _blur;
+        double _sigma;
+
+        // the part of the frame that is processed, empty for all of it
+        Rect _roi;
         const Scalar min_YCrCb;
         const Scalar max_YCrCb;
 
-        CascadeClassifier face_cascade;
+        // the threshold of each channel of the background difference, negative for Otsu
+        Scalar _channelThresholds;
+
+        // finds the faces to black out without holding up the frame
+        FaceTracker face_tracker;
+
+        // the morphology, the iterations of a 3x3 open as one larger open (7x7
+        // by default), and ones a pixel smaller each side for every level down
+        SquareOpen _open[3];
+
+        // buffers reused between frames, sized by the first frame and kept from then on
+        Mat _levels[2];
+        Mat _ycrcb;
+        Mat _raw;
+        Mat _planes[3];
+        Mat _mask;
+        Mat _output;
 
 
     public:
-        Preprocess(const Mat&);
+        Preprocess(const Mat&, const std::string& cascade = "frontal_face.xml",
+                   const PreprocessConfig& config = PreprocessConfig());
         ~Preprocess();
 
-        // thresholds the call by YCrCb channels and erodes and dilates
-        Mat thresholdFilter(Mat&);
+        // replaces the background, blurring it once up front
+        void setBackground(const Mat&);
+
+        // restricts processing to part of the frame, an empty Rect clears it
+        void setRegionOfInterest(const Rect&);
+
+        // processes frames at a pyramid level, 0 for full resolution, 1 for half and 2 for a quarter
+        void setPyramidLevel(int level);
+        int pyramidLevel() const;
+
+        // fixes the threshold of each YCrCb channel, negative ones use Otsu
+        void setChannelThresholds(const Scalar&);
+
+        // thresholds the YCrCb channel planes and erodes and dilates them, in parallel
+        void thresholdFilter(Mat planes[3]);
 
-        // the main interface call to Preprocess
-        Mat operator()(Mat&);
+        // the main interface call to Preprocess, the mask stays valid until the next call
+        const Mat& operator()(const Mat&);
 
         // face detection
-        vector<Rect> faceDetection(Mat& frame);
+        const vector<Rect>& faceDetection(const Mat& frame);
 };
 
 #endif // PREPROCESS_H
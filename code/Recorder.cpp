@@ -0,0 +1,220 @@
+#include "Recorder.h"
+
+#include <cstdio>
+
+/**
+ * The constructor for Recorder
+ *
+ * Nothing is recorded until open is called
+ */
+
+Recorder::Recorder() :
+    _video(false),
+    _fps(15),
+    _fourcc(0),
+    _free(0),
+    _pending(0),
+    _written(0),
+    _dropped(0)
+{}
+
+/**
+ * The destructor for Recorder
+ *
+ * Finishes writing whatever is still waiting
+ */
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+/**
+ * Starts recording to the target given
+ *
+ * A target with a % in it is a pattern for numbered images, anything else is
+ * a video file, with fps and fourcc as passed to VideoWriter. The video is
+ * opened on the first frame, once its size is known. capacity is how many
+ * frames can wait to be written before write starts dropping them, and
+ * workers how many threads encode images at once
+ */
+
+bool Recorder::open(const std::string& target, size_t capacity, int workers, double fps, int fourcc)
+{
+    close();
+
+    _target = target;
+    _video = target.find('%') == std::string::npos;
+    _fps = fps;
+    _fourcc = fourcc;
+    _written = 0;
+    _dropped = 0;
+
+    capacity = std::max<size_t>(1, capacity);
+    _slots.assign(capacity, Slot());
+    _free = new BoundedQueue<Slot*>(capacity);
+    _pending = new BoundedQueue<Slot*>(capacity);
+
+    Slot* unused;
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        _free->push(&_slots[i], unused);
+    }
+
+    // a video has to be written one frame after the other
+    int threads = _video ? 1 : std::max(1, workers);
+    for (int i = 0; i < threads; ++i) {
+        _workers.push_back(std::thread(&Recorder::run, this));
+    }
+
+    return true;
+}
+
+/**
+ * Writes out the frames still waiting, then stops the workers and closes the
+ * video, if there is one
+ */
+
+void Recorder::close()
+{
+    if (!_pending) {
+        return;
+    }
+
+    _pending->close();
+    for (size_t i = 0; i < _workers.size(); ++i) {
+        _workers[i].join();
+    }
+    _workers.clear();
+
+    _writer.release();
+
+    delete _pending;
+    delete _free;
+    _pending = 0;
+    _free = 0;
+}
+
+/**
+ * Returns whether the recorder is open
+ */
+
+bool Recorder::isOpened() const
+{
+    return _pending != 0;
+}
+
+/**
+ * Queues a frame to be written as the frame number given
+ *
+ * The frame is copied (converted to 8 bits on the way, which is what
+ * imwrite would do with it anyway) so the caller can reuse it straight away.
+ * If no buffer is free the frame is dropped instead, and false returned
+ */
+
+bool Recorder::write(const Mat& frame, int index)
+{
+    if (!_free) {
+        return false;
+    }
+
+    Slot* slot;
+    if (!_free->tryPop(slot)) {
+        ++_dropped;
+        return false;
+    }
+
+    if (frame.depth() == CV_8U) {
+        frame.copyTo(slot->image);
+    }
+    else {
+        frame.convertTo(slot->image, CV_8U);
+    }
+    slot->index = index;
+
+    Slot* unused;
+    _pending->push(slot, unused);
+    return true;
+}
+
+/**
+ * Returns the number of frames written so far
+ */
+
+int Recorder::written() const
+{
+    return _written;
+}
+
+/**
+ * Returns the number of frames dropped so far, including any that failed to
+ * be written
+ */
+
+int Recorder::dropped() const
+{
+    return _dropped;
+}
+
+/**
+ * A worker
+ *
+ * Writes pending frames and hands their buffers back, until the recorder is
+ * closed and nothing is left
+ */
+
+void Recorder::run()
+{
+    // the three channel copy of a gray frame for the video, kept per worker
+    Mat color;
+
+    Slot* slot;
+    while (_pending->pop(slot)) {
+        store(*slot, color);
+
+        Slot* unused;
+        _free->push(slot, unused);
+    }
+}
+
+/**
+ * Writes a single frame
+ *
+ * The image name is formatted into a buffer of the size it needs, so the
+ * frame number can grow as large as it likes
+ */
+
+void Recorder::store(const Slot& slot, Mat& color)
+{
+    if (!_video) {
+        int length = snprintf(0, 0, _target.c_str(), slot.index);
+        std::vector<char> name(length + 1);
+        snprintf(&name[0], name.size(), _target.c_str(), slot.index);
+
+        if (imwrite(&name[0], slot.image)) {
+            ++_written;
+        }
+        else {
+            ++_dropped;
+        }
+        return;
+    }
+
+    // the video is always in color
+    const Mat* frame = &slot.image;
+    if (slot.image.channels() == 1) {
+        cvtColor(slot.image, color, CV_GRAY2BGR);
+        frame = &color;
+    }
+
+    if (!_writer.isOpened()) {
+        _writer.open(_target, _fourcc, _fps, frame->size(), true);
+    }
+
+    if (_writer.isOpened()) {
+        _writer << *frame;
+        ++_written;
+    }
+    else {
+        ++_dropped;
+    }
+}
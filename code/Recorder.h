@@ -0,0 +1,90 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv/cv.h>
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "BoundedQueue.h"
+
+/**
+ * The Recorder class
+ *
+ * This writes a stream of frames to disk in the background, for the movies
+ * HandMade makes of its windows
+ *
+ * The target is either a printf style pattern such as
+ * "board/board_%03d.jpg", giving one image per frame, or the name of a video
+ * file such as "board.avi", written with a VideoWriter. write only copies the
+ * frame into a free buffer and returns, encoding is left to a pool of
+ * workers (a single one for a video, which has to be written in order). When
+ * every buffer is still waiting to be written the frame is dropped and
+ * counted rather than holding up the caller
+ */
+
+using namespace cv;
+
+class Recorder
+{
+    private:
+        // a frame waiting to be written, and its number
+        struct Slot
+        {
+            Mat image;
+            int index;
+        };
+
+        std::string _target;
+        bool _video;
+        double _fps;
+        int _fourcc;
+        VideoWriter _writer;
+
+        std::vector<Slot> _slots;
+        BoundedQueue<Slot*>* _free;
+        BoundedQueue<Slot*>* _pending;
+        std::vector<std::thread> _workers;
+
+        std::atomic<int> _written;
+        std::atomic<int> _dropped;
+
+        // a worker, writing pending frames until the recorder is closed
+        void run();
+
+        // writes a single frame to the target
+        void store(const Slot&, Mat& color);
+
+    public:
+        Recorder();
+        ~Recorder();
+
+        // starts recording to the target, with capacity frames waiting at most
+        bool open(const std::string& target, size_t capacity = 8, int workers = 2,
+                  double fps = 15, int fourcc = CV_FOURCC('M', 'J', 'P', 'G'));
+
+        // writes out the frames still waiting and stops the workers
+        void close();
+
+        // true between open and close
+        bool isOpened() const;
+
+        // queues a copy of the frame, false if it had to be dropped
+        bool write(const Mat& frame, int index);
+
+        // the number of frames written so far
+        int written() const;
+
+        // the number of frames dropped so far
+        int dropped() const;
+};
+
+#endif // RECORDER_H
@@ -0,0 +1,116 @@
+#include "Replay.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * The constructor for Replay
+ *
+ * Opens the recorded source and reads the stored background
+ */
+
+Replay::Replay(const std::string& source, const std::string& background) :
+    _cap(source),
+    _bg(imread(background))
+{}
+
+/**
+ * The destructor for Replay
+ *
+ * As of now this does nothing
+ */
+
+Replay::~Replay()
+{}
+
+/**
+ * Both the source and the background need to be present to replay anything
+ */
+
+bool Replay::isOpened() const
+{
+    return _cap.isOpened() && !_bg.empty();
+}
+
+/**
+ * Returns the stored background
+ */
+
+const Mat& Replay::background() const
+{
+    return _bg;
+}
+
+/**
+ * Reads the next frame of the source
+ *
+ * Returns false once the video or image sequence runs out of frames
+ */
+
+bool Replay::next(Mat& frame)
+{
+    return _cap.read(frame) && !frame.empty();
+}
+
+/**
+ * Records a single latency sample
+ */
+
+void LatencyStats::add(double ms)
+{
+    _samples.push_back(ms);
+}
+
+/**
+ * Returns the number of samples recorded so far
+ */
+
+size_t LatencyStats::count() const
+{
+    return _samples.size();
+}
+
+/**
+ * Returns the sum of every sample recorded so far
+ */
+
+double LatencyStats::total() const
+{
+    double sum = 0;
+    for (size_t i = 0; i < _samples.size(); ++i) {
+        sum += _samples[i];
+    }
+    return sum;
+}
+
+/**
+ * Returns the p-th percentile of the samples
+ *
+ * We use the nearest rank method on a sorted copy, so the result is always a
+ * latency that was actually observed
+ */
+
+double LatencyStats::percentile(double p) const
+{
+    if (_samples.empty()) {
+        return 0;
+    }
+
+    std::vector<double> sorted(_samples);
+    std::sort(sorted.begin(), sorted.end());
+
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    if (rank > 0) {
+        --rank;
+    }
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+/**
+ * Converts the ticks elapsed since start to milliseconds
+ */
+
+double elapsedMs(int64 start)
+{
+    return (getTickCount() - start) * 1000.0 / getTickFrequency();
+}
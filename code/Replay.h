@@ -0,0 +1,76 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <string>
+#include <vector>
+
+/**
+ * The Replay class
+ *
+ * This feeds recorded frames to the pipeline instead of a live camera
+ *
+ * The source is anything VideoCapture can open, so either a video file or an
+ * image sequence pattern such as "frames/frame_%03d.jpg". The background is a
+ * single stored image, standing in for what getBackground would have
+ * approximated from the camera
+ */
+
+using namespace cv;
+
+class Replay
+{
+    private:
+        VideoCapture _cap;
+        Mat _bg;
+
+    public:
+        Replay(const std::string& source, const std::string& background);
+        ~Replay();
+
+        // true if both the source and the background could be read
+        bool isOpened() const;
+
+        // the stored background
+        const Mat& background() const;
+
+        // reads the next frame, returns false once the source is exhausted
+        bool next(Mat& frame);
+};
+
+/**
+ * The LatencyStats class
+ *
+ * Collects the latency samples of a single pipeline stage and reports
+ * percentiles over them
+ */
+
+class LatencyStats
+{
+    private:
+        std::vector<double> _samples;
+
+    public:
+        // records a sample, in milliseconds
+        void add(double ms);
+
+        // the number of samples recorded
+        size_t count() const;
+
+        // the sum of all samples, in milliseconds
+        double total() const;
+
+        // the p-th percentile (0 - 100) by nearest rank
+        double percentile(double p) const;
+};
+
+// milliseconds elapsed since the tick count passed in
+double elapsedMs(int64 start);
+
+#endif // REPLAY_H
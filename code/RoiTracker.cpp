@@ -0,0 +1,103 @@
+#include "RoiTracker.h"
+
+#include <algorithm>
+
+/**
+ * The constructor for RoiTracker
+ *
+ * padding scales the hand's radius to the half width of the region of
+ * interest, and minRadius keeps it from collapsing on a small detection
+ */
+
+RoiTracker::RoiTracker(double padding, int minRadius) :
+    _tracking(false),
+    _maxHands(1),
+    _padding(padding),
+    _minRadius(minRadius),
+    _step(32)
+{}
+
+/**
+ * The destructor for RoiTracker
+ *
+ * As of now this does nothing
+ */
+
+RoiTracker::~RoiTracker()
+{}
+
+/**
+ * Sets how many hands Detect looks for
+ *
+ * The region of interest only follows a single hand. With more than one,
+ * update always returns the full frame, so a hand can come in anywhere
+ */
+
+void RoiTracker::setMaxHands(int maxHands)
+{
+    _maxHands = maxHands;
+}
+
+/**
+ * Updates the region of interest with the circles Detect found
+ *
+ * The hand's radius is the larger of the min enclosing circle and twice the
+ * palm's radius, since the enclosing circle alone shrinks when the fingers
+ * are folded. The region is a square around the enclosing circle's center,
+ * its half width rounded up to a multiple of _step, and shifted to lie inside
+ * the frame. It is only cut down when it is larger than the frame. A missing
+ * palm means the hand was lost, and the whole frame is returned, as it is
+ * whenever more than one hand is looked for
+ */
+
+Rect RoiTracker::update(const std::pair<Point, double>& maxCircle,
+                        const std::pair<Point2f, float>& minCircle,
+                        const Size& frameSize)
+{
+    Rect frame(0, 0, frameSize.width, frameSize.height);
+
+    _tracking = _maxHands <= 1 && maxCircle.second > 0 && minCircle.second > 0;
+    if (!_tracking) {
+        _roi = frame;
+        return _roi;
+    }
+
+    double radius = std::max((double)minCircle.second, 2 * maxCircle.second);
+    int half = std::max(_minRadius, (int)(radius * _padding));
+    half = (half + _step - 1) / _step * _step;
+
+    int width = std::min(2 * half, frame.width);
+    int height = std::min(2 * half, frame.height);
+
+    // center the square on the hand, then move it back inside the frame
+    Point center(cvRound(minCircle.first.x), cvRound(minCircle.first.y));
+    int x = std::min(std::max(center.x - half, 0), frame.width - width);
+    int y = std::min(std::max(center.y - half, 0), frame.height - height);
+    _roi = Rect(x, y, width, height);
+
+    // an empty frame leaves nothing to track
+    if (_roi.area() <= 0) {
+        _tracking = false;
+        _roi = frame;
+    }
+
+    return _roi;
+}
+
+/**
+ * Returns the current region of interest
+ */
+
+Rect RoiTracker::roi() const
+{
+    return _roi;
+}
+
+/**
+ * Returns whether a hand is being tracked
+ */
+
+bool RoiTracker::isTracking() const
+{
+    return _tracking;
+}
@@ -0,0 +1,67 @@
+#ifndef ROITRACKER_H
+#define ROITRACKER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * The RoiTracker class
+ *
+ * This decides which part of the next frame Preprocess needs to look at
+ *
+ * After every frame it is given the palm circle and the min enclosing circle
+ * Detect found. While a hand is found, the next region of interest is the
+ * enclosing circle's bounding square, padded to allow for the hand moving
+ * between frames. As soon as the hand is lost, it falls back to the full
+ * frame so the hand can be found again anywhere. While more than one hand
+ * is looked for, the region is always the full frame, since a second hand
+ * could come in anywhere
+ *
+ * The size of the region only changes in steps, and the region is moved back
+ * inside the frame rather than clipped at its edge, so from one frame to the
+ * next the buffers Preprocess keeps can almost always be reused as they are
+ */
+
+using namespace cv;
+
+class RoiTracker
+{
+    private:
+        Rect _roi;
+        bool _tracking;
+
+        // the most hands looked for, more than one keeps the full frame
+        int _maxHands;
+
+        // how much larger than the hand the region of interest is
+        const double _padding;
+
+        // the smallest half width of the region of interest, in pixels
+        const int _minRadius;
+
+        // the half width is rounded up to a multiple of this, in pixels
+        const int _step;
+
+    public:
+        RoiTracker(double padding = 1.5, int minRadius = 40);
+        ~RoiTracker();
+
+        // how many hands Detect looks for, the region only follows a single hand
+        void setMaxHands(int maxHands);
+
+        // updates the region of interest with the hand found in the last frame
+        Rect update(const std::pair<Point, double>& maxCircle,
+                    const std::pair<Point2f, float>& minCircle,
+                    const Size& frameSize);
+
+        // the current region of interest
+        Rect roi() const;
+
+        // true if the region of interest follows a hand, false if it is the full frame
+        bool isTracking() const;
+};
+
+#endif // ROITRACKER_H
@@ -0,0 +1,400 @@
+#include "Segment.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// ==========
+// constants
+// ==========
+
+// the fixed point YCrCb to BGR coefficients OpenCV uses for 8 bit images
+static const int YCRCB_SHIFT = 14;
+static const int CR2R = 22987;
+static const int CR2G = -11698;
+static const int CB2G = -5636;
+static const int CB2B = 29049;
+
+// the fixed point BGR to gray coefficients, which OpenCV 4 made more precise
+#if CV_MAJOR_VERSION >= 4
+static const int GRAY_SHIFT = 15;
+static const int B2Y = 3735;
+static const int G2Y = 19235;
+static const int R2Y = 9798;
+#else
+static const int GRAY_SHIFT = 14;
+static const int B2Y = 1868;
+static const int G2Y = 9617;
+static const int R2Y = 4899;
+#endif
+
+// the gray level threshold Preprocess has always used on the masked frame
+static const int GRAY_THRESHOLD = 120;
+
+/**
+ * clamps a value into the range of a uchar
+ */
+
+static inline int clamp8(int v)
+{
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+/**
+ * the gray level of a YCrCb pixel, computed exactly the way
+ * cvtColor(CV_YCrCb2BGR) followed by cvtColor(CV_BGR2GRAY) does it
+ */
+
+static inline int grayOf(int y, int cr, int cb)
+{
+    cr -= 128;
+    cb -= 128;
+
+    int b = clamp8(y + ((cb * CB2B + (1 << (YCRCB_SHIFT - 1))) >> YCRCB_SHIFT));
+    int g = clamp8(y + ((cb * CB2G + cr * CR2G + (1 << (YCRCB_SHIFT - 1))) >> YCRCB_SHIFT));
+    int r = clamp8(y + ((cr * CR2R + (1 << (YCRCB_SHIFT - 1))) >> YCRCB_SHIFT));
+
+    return (b * B2Y + g * G2Y + r * R2Y + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT;
+}
+
+// ================
+// scalar kernels
+// ================
+
+/**
+ * one row of thresholdDifference, from pixel i to n
+ */
+
+static void differenceRow(const uchar* frame, const uchar* bg, const int thresholds[3],
+                          uchar* planes[3], int i, int n)
+{
+    for (; i < n; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            int diff = frame[3*i + c] - bg[3*i + c];
+            diff = diff < 0 ? 0 : diff;
+
+            if (thresholds[c] < 0) {
+                planes[c][i] = (uchar)diff;
+            }
+            else {
+                planes[c][i] = diff > thresholds[c] ? 255 : 0;
+            }
+        }
+    }
+}
+
+/**
+ * one row of skinMask, from pixel i to n
+ */
+
+static void skinRow(const uchar* masks[3], const uchar* raw, const uchar lo[3], const uchar hi[3],
+                    uchar* mask, int i, int n)
+{
+    for (; i < n; ++i) {
+        int y  = raw[3*i];
+        int cr = raw[3*i + 1];
+        int cb = raw[3*i + 2];
+
+        bool skin = lo[0] <= y  && y  <= hi[0] &&
+                    lo[1] <= cr && cr <= hi[1] &&
+                    lo[2] <= cb && cb <= hi[2];
+
+        bool dark = grayOf(y & masks[0][i], cr & masks[1][i], cb & masks[2][i]) <= GRAY_THRESHOLD;
+
+        mask[i] = skin == dark ? 255 : 0;
+    }
+}
+
+// ==============
+// SIMD kernels
+// ==============
+
+#if defined(__SSSE3__)
+
+/**
+ * splits 16 interleaved three channel pixels into one register per channel
+ */
+
+static inline void deinterleave(const uchar* p, __m128i& c0, __m128i& c1, __m128i& c2)
+{
+    const __m128i a = _mm_loadu_si128((const __m128i*)p);
+    const __m128i b = _mm_loadu_si128((const __m128i*)(p + 16));
+    const __m128i c = _mm_loadu_si128((const __m128i*)(p + 32));
+
+    c0 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    c1 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    c2 = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(b, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(c, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+// the width of the vector kernels, in pixels
+static const int LANES = 32;
+typedef __m256i vec;
+
+/**
+ * splits 32 interleaved three channel pixels into one register per channel
+ */
+
+static inline void load3(const uchar* p, vec& c0, vec& c1, vec& c2)
+{
+    __m128i a0, a1, a2, b0, b1, b2;
+    deinterleave(p, a0, a1, a2);
+    deinterleave(p + 48, b0, b1, b2);
+    c0 = _mm256_inserti128_si256(_mm256_castsi128_si256(a0), b0, 1);
+    c1 = _mm256_inserti128_si256(_mm256_castsi128_si256(a1), b1, 1);
+    c2 = _mm256_inserti128_si256(_mm256_castsi128_si256(a2), b2, 1);
+}
+
+static inline vec load(const uchar* p) { return _mm256_loadu_si256((const vec*)p); }
+static inline void store(uchar* p, vec v) { _mm256_storeu_si256((vec*)p, v); }
+static inline vec set8(int v) { return _mm256_set1_epi8((char)v); }
+static inline vec set16(int v) { return _mm256_set1_epi16((short)v); }
+static inline vec set32(int v) { return _mm256_set1_epi32(v); }
+static inline vec pair16(int a, int b) { return _mm256_set1_epi32((int)(((unsigned)b << 16) | ((unsigned)a & 0xffff))); }
+static inline vec zero() { return _mm256_setzero_si256(); }
+static inline vec and_(vec a, vec b) { return _mm256_and_si256(a, b); }
+static inline vec xor_(vec a, vec b) { return _mm256_xor_si256(a, b); }
+static inline vec subs8(vec a, vec b) { return _mm256_subs_epu8(a, b); }
+static inline vec eq8(vec a, vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline vec max8(vec a, vec b) { return _mm256_max_epu8(a, b); }
+static inline vec min8(vec a, vec b) { return _mm256_min_epu8(a, b); }
+static inline vec lo8(vec a) { return _mm256_unpacklo_epi8(a, zero()); }
+static inline vec hi8(vec a) { return _mm256_unpackhi_epi8(a, zero()); }
+static inline vec lo16(vec a, vec b) { return _mm256_unpacklo_epi16(a, b); }
+static inline vec hi16(vec a, vec b) { return _mm256_unpackhi_epi16(a, b); }
+static inline vec add16(vec a, vec b) { return _mm256_add_epi16(a, b); }
+static inline vec sub16(vec a, vec b) { return _mm256_sub_epi16(a, b); }
+static inline vec shl16(vec a) { return _mm256_slli_epi16(a, 1); }
+static inline vec mulhrs16(vec a, vec b) { return _mm256_mulhrs_epi16(a, b); }
+static inline vec max16(vec a, vec b) { return _mm256_max_epi16(a, b); }
+static inline vec min16(vec a, vec b) { return _mm256_min_epi16(a, b); }
+static inline vec madd16(vec a, vec b) { return _mm256_madd_epi16(a, b); }
+static inline vec add32(vec a, vec b) { return _mm256_add_epi32(a, b); }
+static inline vec sra32(vec a, int n) { return _mm256_srai_epi32(a, n); }
+static inline vec pack32(vec a, vec b) { return _mm256_packs_epi32(a, b); }
+static inline vec pack16(vec a, vec b) { return _mm256_packus_epi16(a, b); }
+
+#elif defined(__SSSE3__)
+
+static const int LANES = 16;
+typedef __m128i vec;
+
+static inline void load3(const uchar* p, vec& c0, vec& c1, vec& c2) { deinterleave(p, c0, c1, c2); }
+static inline vec load(const uchar* p) { return _mm_loadu_si128((const vec*)p); }
+static inline void store(uchar* p, vec v) { _mm_storeu_si128((vec*)p, v); }
+static inline vec set8(int v) { return _mm_set1_epi8((char)v); }
+static inline vec set16(int v) { return _mm_set1_epi16((short)v); }
+static inline vec set32(int v) { return _mm_set1_epi32(v); }
+static inline vec pair16(int a, int b) { return _mm_set1_epi32((int)(((unsigned)b << 16) | ((unsigned)a & 0xffff))); }
+static inline vec zero() { return _mm_setzero_si128(); }
+static inline vec and_(vec a, vec b) { return _mm_and_si128(a, b); }
+static inline vec xor_(vec a, vec b) { return _mm_xor_si128(a, b); }
+static inline vec subs8(vec a, vec b) { return _mm_subs_epu8(a, b); }
+static inline vec eq8(vec a, vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline vec max8(vec a, vec b) { return _mm_max_epu8(a, b); }
+static inline vec min8(vec a, vec b) { return _mm_min_epu8(a, b); }
+static inline vec lo8(vec a) { return _mm_unpacklo_epi8(a, zero()); }
+static inline vec hi8(vec a) { return _mm_unpackhi_epi8(a, zero()); }
+static inline vec lo16(vec a, vec b) { return _mm_unpacklo_epi16(a, b); }
+static inline vec hi16(vec a, vec b) { return _mm_unpackhi_epi16(a, b); }
+static inline vec add16(vec a, vec b) { return _mm_add_epi16(a, b); }
+static inline vec sub16(vec a, vec b) { return _mm_sub_epi16(a, b); }
+static inline vec shl16(vec a) { return _mm_slli_epi16(a, 1); }
+static inline vec mulhrs16(vec a, vec b) { return _mm_mulhrs_epi16(a, b); }
+static inline vec max16(vec a, vec b) { return _mm_max_epi16(a, b); }
+static inline vec min16(vec a, vec b) { return _mm_min_epi16(a, b); }
+static inline vec madd16(vec a, vec b) { return _mm_madd_epi16(a, b); }
+static inline vec add32(vec a, vec b) { return _mm_add_epi32(a, b); }
+static inline vec sra32(vec a, int n) { return _mm_srai_epi32(a, n); }
+static inline vec pack32(vec a, vec b) { return _mm_packs_epi32(a, b); }
+static inline vec pack16(vec a, vec b) { return _mm_packus_epi16(a, b); }
+
+#endif
+
+#if defined(__SSSE3__)
+
+/**
+ * the vector version of differenceRow
+ *
+ * x > t is tested as the saturated x - t being non zero. Returns the first
+ * pixel it did not process, which the scalar kernel picks up from
+ */
+
+static int differenceRowSimd(const uchar* frame, const uchar* bg, const int thresholds[3],
+                             uchar* planes[3], int n)
+{
+    vec t[3];
+    for (int c = 0; c < 3; ++c) {
+        t[c] = set8(thresholds[c] < 255 ? thresholds[c] : 255);
+    }
+
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        vec f[3], b[3];
+        load3(frame + 3*i, f[0], f[1], f[2]);
+        load3(bg + 3*i, b[0], b[1], b[2]);
+
+        for (int c = 0; c < 3; ++c) {
+            vec diff = subs8(f[c], b[c]);
+            if (thresholds[c] >= 0) {
+                // 0xff where the difference does not exceed the threshold, flipped
+                diff = xor_(eq8(subs8(diff, t[c]), zero()), set8(0xff));
+            }
+            store(planes[c] + i, diff);
+        }
+    }
+
+    return i;
+}
+
+/**
+ * the gray level of a vector of YCrCb pixels widened to 16 bits
+ *
+ * (x * C + 2^13) >> 14 is computed as mulhrs(2x, C), which rounds the same
+ * way, and the sums of two products go through madd in 32 bits
+ */
+
+static inline vec gray16(vec y, vec cr, vec cb)
+{
+    const vec half = set16(128);
+    const vec lo = zero();
+    const vec hi = set16(255);
+
+    cr = sub16(cr, half);
+    cb = sub16(cb, half);
+
+    vec b = min16(max16(add16(y, mulhrs16(shl16(cb), set16(CB2B))), lo), hi);
+    vec r = min16(max16(add16(y, mulhrs16(shl16(cr), set16(CR2R))), lo), hi);
+
+    const vec gcoeffs = pair16(CB2G, CR2G);
+    const vec round = set32(1 << (YCRCB_SHIFT - 1));
+    vec gl = sra32(add32(madd16(lo16(cb, cr), gcoeffs), round), YCRCB_SHIFT);
+    vec gh = sra32(add32(madd16(hi16(cb, cr), gcoeffs), round), YCRCB_SHIFT);
+    vec g = min16(max16(add16(y, pack32(gl, gh)), lo), hi);
+
+    const vec bg = pair16(B2Y, G2Y);
+    const vec r1 = pair16(R2Y, 1 << (GRAY_SHIFT - 1));
+    const vec one = set16(1);
+    vec yl = sra32(add32(madd16(lo16(b, g), bg), madd16(lo16(r, one), r1)), GRAY_SHIFT);
+    vec yh = sra32(add32(madd16(hi16(b, g), bg), madd16(hi16(r, one), r1)), GRAY_SHIFT);
+
+    return pack32(yl, yh);
+}
+
+/**
+ * the vector version of skinRow
+ *
+ * lo <= x <= hi is tested as max(x, lo) == x and min(x, hi) == x. Returns
+ * the first pixel it did not process
+ */
+
+static int skinRowSimd(const uchar* masks[3], const uchar* raw, const uchar lo[3], const uchar hi[3],
+                       uchar* mask, int n)
+{
+    vec vlo[3], vhi[3];
+    for (int c = 0; c < 3; ++c) {
+        vlo[c] = set8(lo[c]);
+        vhi[c] = set8(hi[c]);
+    }
+    const vec threshold = set8(GRAY_THRESHOLD);
+
+    int i = 0;
+    for (; i + LANES <= n; i += LANES) {
+        vec ycc[3];
+        load3(raw + 3*i, ycc[0], ycc[1], ycc[2]);
+
+        vec skin = set8(0xff);
+        for (int c = 0; c < 3; ++c) {
+            skin = and_(skin, and_(eq8(max8(ycc[c], vlo[c]), ycc[c]), eq8(min8(ycc[c], vhi[c]), ycc[c])));
+        }
+
+        vec y  = and_(ycc[0], load(masks[0] + i));
+        vec cr = and_(ycc[1], load(masks[1] + i));
+        vec cb = and_(ycc[2], load(masks[2] + i));
+
+        vec gray = pack16(gray16(lo8(y), lo8(cr), lo8(cb)), gray16(hi8(y), hi8(cr), hi8(cb)));
+        vec dark = eq8(subs8(gray, threshold), zero());
+
+        store(mask + i, eq8(skin, dark));
+    }
+
+    return i;
+}
+
+#endif
+
+// ============
+// interface
+// ============
+
+/**
+ * Subtracts the background and thresholds every channel in one pass
+ *
+ * This replaces subtract, split and the per channel threshold. The planes
+ * are (re)allocated only if their size changed
+ */
+
+void thresholdDifference(const Mat& frame, const Mat& bg, const Scalar& thresholds, Mat planes[3])
+{
+    CV_Assert(frame.type() == CV_8UC3 && bg.type() == CV_8UC3 && frame.size() == bg.size());
+
+    int t[3];
+    for (int c = 0; c < 3; ++c) {
+        planes[c].create(frame.size(), CV_8U);
+        t[c] = thresholds[c] < 0 ? -1 : cvFloor(thresholds[c]);
+    }
+
+    for (int row = 0; row < frame.rows; ++row) {
+        uchar* out[3] = { planes[0].ptr(row), planes[1].ptr(row), planes[2].ptr(row) };
+        int i = 0;
+#if defined(__SSSE3__)
+        i = differenceRowSimd(frame.ptr(row), bg.ptr(row), t, out, frame.cols);
+#endif
+        differenceRow(frame.ptr(row), bg.ptr(row), t, out, i, frame.cols);
+    }
+}
+
+/**
+ * Builds the final mask from the channel masks and the raw frame in one pass
+ *
+ * This replaces merge, bitwise_and, both cvtColors, the gray threshold,
+ * inRange and compare
+ */
+
+void skinMask(const Mat planes[3], const Mat& raw,
+              const Scalar& minYCrCb, const Scalar& maxYCrCb, Mat& mask)
+{
+    CV_Assert(raw.type() == CV_8UC3);
+
+    uchar lo[3], hi[3];
+    for (int c = 0; c < 3; ++c) {
+        CV_Assert(planes[c].type() == CV_8U && planes[c].size() == raw.size());
+        lo[c] = saturate_cast<uchar>(minYCrCb[c]);
+        hi[c] = saturate_cast<uchar>(maxYCrCb[c]);
+    }
+
+    mask.create(raw.size(), CV_8U);
+
+    for (int row = 0; row < raw.rows; ++row) {
+        const uchar* masks[3] = { planes[0].ptr(row), planes[1].ptr(row), planes[2].ptr(row) };
+        int i = 0;
+#if defined(__SSSE3__)
+        i = skinRowSimd(masks, raw.ptr(row), lo, hi, mask.ptr(row), raw.cols);
+#endif
+        skinRow(masks, raw.ptr(row), lo, hi, mask.ptr(row), i, raw.cols);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * The fused segmentation kernels
+ *
+ * Preprocess used to build the hand mask out of a long chain of full image
+ * passes (subtract, split, threshold, merge, bitwise_and, two cvtColors,
+ * threshold, inRange and compare), each writing a temporary image. Only the
+ * morphology in the middle of that chain needs to look at neighbouring
+ * pixels, so everything before it and everything after it is done here in a
+ * single pass each, reading every input pixel once
+ *
+ * Both kernels have SSSE3 and AVX2 versions, picked at compile time, and a
+ * scalar version for everything else. All three give exactly the same output
+ * as the OpenCV chain they replace
+ */
+
+using namespace cv;
+
+// subtracts the background from the frame channel by channel, saturating at
+// 0, and writes one plane per channel, holding 255 where the difference is
+// above that channel's threshold and 0 elsewhere. A negative threshold leaves
+// the difference in the plane, so it can be thresholded with Otsu's method
+// afterwards. The channels are only subtracted, so Preprocess passes a YCrCb
+// frame and the BGR background, as the chain it replaces always did
+void thresholdDifference(const Mat& frame, const Mat& bg, const Scalar& thresholds, Mat planes[3]);
+
+// ands the three channel masks with the raw YCrCb frame, converts the
+// result to grayscale, thresholds it at 120 and compares it with the skin
+// range of the raw frame, giving the final 255 / 0 mask
+void skinMask(const Mat planes[3], const Mat& raw,
+              const Scalar& minYCrCb, const Scalar& maxYCrCb, Mat& mask);
+
+#endif // SEGMENT_H
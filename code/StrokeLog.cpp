@@ -0,0 +1,368 @@
+#include "StrokeLog.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// the first bytes of every stroke log
+static const char strokeMagic[4] = { 'H', 'M', 'S', 'L' };
+static const uchar strokeVersion = 1;
+
+/**
+ * appends an unsigned integer, seven bits to a byte, low bits first, with
+ * the high bit of every byte but the last set
+ */
+
+static void putUnsigned(std::vector<uchar>& out, unsigned long long value)
+{
+    while (value >= 0x80) {
+        out.push_back((uchar)(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((uchar)value);
+}
+
+/**
+ * appends a signed integer, zig zag encoded so small negative numbers stay
+ * small too
+ */
+
+static void putSigned(std::vector<uchar>& out, long long value)
+{
+    putUnsigned(out, ((unsigned long long)value << 1) ^ (unsigned long long)(value >> 63));
+}
+
+/**
+ * The constructor for StrokeLog
+ *
+ * Nothing is recorded until open is called
+ */
+
+StrokeLog::StrokeLog() :
+    _file(0),
+    _bytes(0),
+    _lastTime(0)
+{}
+
+/**
+ * The destructor for StrokeLog
+ *
+ * Closes the log, if it is open
+ */
+
+StrokeLog::~StrokeLog()
+{
+    close();
+}
+
+/**
+ * Starts a new log at the path given and writes its header
+ */
+
+bool StrokeLog::open(const std::string& path)
+{
+    close();
+
+    _file = fopen(path.c_str(), "wb");
+    if (!_file) {
+        return false;
+    }
+
+    fwrite(strokeMagic, 1, sizeof(strokeMagic), _file);
+    fwrite(&strokeVersion, 1, 1, _file);
+    _bytes = sizeof(strokeMagic) + 1;
+    _lastTime = 0;
+    _lastPoint = Point(0, 0);
+    return true;
+}
+
+/**
+ * Flushes and closes the log
+ */
+
+void StrokeLog::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = 0;
+    }
+}
+
+/**
+ * Returns whether the log is open
+ */
+
+bool StrokeLog::isOpened() const
+{
+    return _file != 0;
+}
+
+/**
+ * Records a line between two board points, drawn at the time given in
+ * milliseconds since the log was opened
+ */
+
+void StrokeLog::line(const Point& from, const Point& to, int width, int64 time)
+{
+    append(STROKE_LINE, time, from, &to, width);
+}
+
+/**
+ * Records a disk erased around a board point
+ */
+
+void StrokeLog::erase(const Point& center, int radius, int64 time)
+{
+    append(STROKE_ERASE, time, center, 0, radius);
+}
+
+/**
+ * Encodes an event and appends it to the file
+ *
+ * The whole record is written at once, so the file only ever ends in the
+ * middle of a record if the program dies inside fwrite
+ */
+
+void StrokeLog::append(StrokeType type, int64 time, const Point& from, const Point* to, int size)
+{
+    if (!_file) {
+        return;
+    }
+
+    _record.clear();
+    _record.push_back((uchar)type);
+    putUnsigned(_record, (unsigned long long)std::max<int64>(0, time - _lastTime));
+    putSigned(_record, from.x - _lastPoint.x);
+    putSigned(_record, from.y - _lastPoint.y);
+    if (to) {
+        putSigned(_record, to->x - from.x);
+        putSigned(_record, to->y - from.y);
+    }
+    putUnsigned(_record, (unsigned long long)std::max(0, size));
+
+    fwrite(&_record[0], 1, _record.size(), _file);
+    _bytes += _record.size();
+
+    _lastTime = std::max(_lastTime, time);
+    _lastPoint = to ? *to : from;
+}
+
+/**
+ * Returns the number of bytes in the log so far
+ */
+
+size_t StrokeLog::bytes() const
+{
+    return _bytes;
+}
+
+/**
+ * The constructor for StrokeReader
+ */
+
+StrokeReader::StrokeReader() :
+    _map(0),
+    _mapSize(0),
+    _data(0),
+    _size(0),
+    _pos(0),
+    _lastTime(0)
+{}
+
+/**
+ * The destructor for StrokeReader
+ *
+ * Unmaps the log, if it is mapped
+ */
+
+StrokeReader::~StrokeReader()
+{
+    close();
+}
+
+/**
+ * Maps the log at the path given
+ */
+
+bool StrokeReader::open(const std::string& path)
+{
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+
+    // the kernel can read ahead, the log is only ever read front to back
+    madvise(map, info.st_size, MADV_SEQUENTIAL);
+
+    if (!open((const uchar*)map, info.st_size)) {
+        munmap(map, info.st_size);
+        return false;
+    }
+
+    _map = map;
+    _mapSize = info.st_size;
+    return true;
+}
+
+/**
+ * Reads a log that is already in memory, checking its header
+ */
+
+bool StrokeReader::open(const uchar* data, size_t size)
+{
+    if (size < sizeof(strokeMagic) + 1 ||
+        memcmp(data, strokeMagic, sizeof(strokeMagic)) != 0 ||
+        data[sizeof(strokeMagic)] != strokeVersion) {
+        return false;
+    }
+
+    _data = data;
+    _size = size;
+    _pos = sizeof(strokeMagic) + 1;
+    _lastTime = 0;
+    _lastPoint = Point(0, 0);
+    return true;
+}
+
+/**
+ * Unmaps the log
+ */
+
+void StrokeReader::close()
+{
+    if (_map) {
+        munmap(_map, _mapSize);
+    }
+
+    _map = 0;
+    _mapSize = 0;
+    _data = 0;
+    _size = 0;
+    _pos = 0;
+}
+
+/**
+ * Decodes an unsigned integer, false if the log ends inside it
+ */
+
+bool StrokeReader::readUnsigned(unsigned long long& value)
+{
+    value = 0;
+    for (int shift = 0; _pos < _size && shift < 64; shift += 7) {
+        uchar byte = _data[_pos++];
+        value |= (unsigned long long)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Decodes a zig zag encoded integer
+ */
+
+bool StrokeReader::readSigned(long long& value)
+{
+    unsigned long long raw;
+    if (!readUnsigned(raw)) {
+        return false;
+    }
+    value = (long long)(raw >> 1) ^ -(long long)(raw & 1);
+    return true;
+}
+
+/**
+ * Decodes the next event
+ *
+ * Returns false at the end of the log, and also at a record that is cut
+ * short or of an unknown type, after which nothing more is read
+ */
+
+bool StrokeReader::next(StrokeEvent& event)
+{
+    if (_pos >= _size) {
+        return false;
+    }
+
+    uchar type = _data[_pos++];
+    unsigned long long dt;
+    unsigned long long size;
+    long long dx, dy;
+
+    if ((type != STROKE_LINE && type != STROKE_ERASE) ||
+        !readUnsigned(dt) || !readSigned(dx) || !readSigned(dy)) {
+        _pos = _size;
+        return false;
+    }
+
+    event.type = (StrokeType)type;
+    event.time = _lastTime + (int64)dt;
+    event.from = Point(_lastPoint.x + (int)dx, _lastPoint.y + (int)dy);
+    event.to = event.from;
+
+    if (type == STROKE_LINE) {
+        if (!readSigned(dx) || !readSigned(dy)) {
+            _pos = _size;
+            return false;
+        }
+        event.to = Point(event.from.x + (int)dx, event.from.y + (int)dy);
+    }
+
+    if (!readUnsigned(size)) {
+        _pos = _size;
+        return false;
+    }
+    event.size = (int)size;
+
+    _lastTime = event.time;
+    _lastPoint = event.to;
+    return true;
+}
+
+/**
+ * Draws a recorded session onto the canvas
+ *
+ * The events are applied back to back with no regard for their times, so
+ * a session is redrawn far faster than it was drawn. Returns the number of
+ * events, or -1 if the log could not be opened
+ */
+
+int replayStrokes(const std::string& path, Canvas& canvas)
+{
+    StrokeReader reader;
+    if (!reader.open(path)) {
+        return -1;
+    }
+
+    StrokeEvent event;
+    int count = 0;
+    while (reader.next(event)) {
+        if (event.type == STROKE_LINE) {
+            canvas.line(event.from, event.to, event.size);
+        }
+        else {
+            canvas.erase(event.from, event.size);
+        }
+        ++count;
+    }
+    return count;
+}
@@ -0,0 +1,145 @@
+#ifndef STROKELOG_H
+#define STROKELOG_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "Canvas.h"
+
+using namespace cv;
+
+// the kinds of event in a stroke log
+enum StrokeType
+{
+    STROKE_LINE = 1,
+    STROKE_ERASE = 2
+};
+
+// a single event
+struct StrokeEvent
+{
+    StrokeType type;
+
+    // the milliseconds since the log was opened
+    int64 time;
+
+    // the ends of a line, or the center of an erased disk in both
+    Point from;
+    Point to;
+
+    // the width of a line, or the radius of an erased disk
+    int size;
+};
+
+/**
+ * The StrokeLog class
+ *
+ * This records every line drawn on and every disk erased from the
+ * whiteboard as a vector command rather than as pixels, so a whole session
+ * can be saved in a few kilobytes and drawn again later
+ *
+ * The file starts with the magic "HMSL" and a version byte, followed by one
+ * record per event. A record is the event type in a byte, then variable
+ * length integers: the milliseconds since the previous event, the start (or
+ * center) as an offset from where the previous event ended, the end of a
+ * line as an offset from its start, and the width or radius. Consecutive
+ * strokes start where the last one ended, so most offsets fit in a byte.
+ * Records are only ever appended, and a record cut short by a crash is
+ * simply where reading stops
+ */
+
+class StrokeLog
+{
+    private:
+        FILE* _file;
+        size_t _bytes;
+
+        // the previous event's time and end point, the deltas are taken from them
+        int64 _lastTime;
+        Point _lastPoint;
+
+        // the record being encoded
+        std::vector<uchar> _record;
+
+        // encodes the fields shared by every event and writes the record
+        void append(StrokeType, int64 time, const Point& from, const Point* to, int size);
+
+    public:
+        StrokeLog();
+        ~StrokeLog();
+
+        // starts a new log at the path given, replacing any file there
+        bool open(const std::string& path);
+
+        // flushes and closes the log
+        void close();
+
+        // true between open and close
+        bool isOpened() const;
+
+        // records a line between two board points
+        void line(const Point& from, const Point& to, int width, int64 time);
+
+        // records an erased disk
+        void erase(const Point& center, int radius, int64 time);
+
+        // the number of bytes written, header included
+        size_t bytes() const;
+};
+
+/**
+ * The StrokeReader class
+ *
+ * Reads the events back out of a stroke log
+ *
+ * The file is memory mapped rather than read, and the events are decoded
+ * straight out of the mapping one at a time, so loading a session costs
+ * nothing up front whatever its length
+ */
+
+class StrokeReader
+{
+    private:
+        // the mapping, if the log came from a file
+        void* _map;
+        size_t _mapSize;
+
+        const uchar* _data;
+        size_t _size;
+        size_t _pos;
+
+        int64 _lastTime;
+        Point _lastPoint;
+
+        // decodes an unsigned and a zig zag encoded integer, false past the end
+        bool readUnsigned(unsigned long long&);
+        bool readSigned(long long&);
+
+    public:
+        StrokeReader();
+        ~StrokeReader();
+
+        // maps the log at the path given, false if it is missing or not a log
+        bool open(const std::string& path);
+
+        // reads a log already in memory, which has to outlive the reader
+        bool open(const uchar* data, size_t size);
+
+        // unmaps the log
+        void close();
+
+        // decodes the next event, false at the end of the log
+        bool next(StrokeEvent& event);
+};
+
+// draws every event in the log onto the canvas as fast as possible, returns the number of events
+int replayStrokes(const std::string& path, Canvas& canvas);
+
+#endif // STROKELOG_H
@@ -1,12 +1,59 @@
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <thread>
+
 #define private public
 
 #include <iostream>
 #include "Preprocess.h"
 #include "Detect.h"
+#include "Background.h"
+#include "RoiTracker.h"
+#include "FaceTracker.h"
+#include "Segment.h"
+#include "Morphology.h"
+#include "Pipeline.h"
+#include "Visualizer.h"
+#include "Recorder.h"
+#include "Canvas.h"
+#include "StrokeLog.h"
+#include "TipFilter.h"
+#include "TipTracker.h"
+#include "Gesture.h"
+#include "Trace.h"
+#include "Corpus.h"
+#include "Config.h"
 #include "gtest/gtest.h"
 
 using namespace cv;
 
+// counts the heap allocations made while countingAllocations is set. Only
+// operator new is counted, so this sees the vectors of the workspaces but not
+// the Mats, which OpenCV allocates with fastMalloc
+std::atomic<bool> countingAllocations(false);
+std::atomic<int> allocations(0);
+
+void* operator new(size_t size) {
+    if (countingAllocations) {
+        ++allocations;
+    }
+    void* p = malloc(size ? size : 1);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    free(p);
+}
+
 TEST(Detect, euclideanDist) {
     Detect d;
     Point p(2, -1);
@@ -107,6 +154,323 @@ TEST(Detect, findMaxInscribedCircle) {
 
 }
 
+TEST(Detect, findMaxInscribedCircleSquare) {
+    vector<vector<Point>> polyCurves(1);
+    polyCurves[0].push_back(Point(50, 50));
+    polyCurves[0].push_back(Point(149, 50));
+    polyCurves[0].push_back(Point(149, 149));
+    polyCurves[0].push_back(Point(50, 149));
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    Detect d(PALM_DISTANCE_TRANSFORM);
+    std::pair<Point, double> actual = d.findMaxInscribedCircle(polyCurves, frame);
+    ASSERT_EQ(99, actual.first.x);
+    ASSERT_EQ(99, actual.first.y);
+    ASSERT_EQ(50, actual.second);
+}
+
+TEST(Detect, findMaxInscribedCircleEngines) {
+    vector<vector<Point>> polyCurves(1);
+    polyCurves[0].push_back(Point(100, 100));
+    polyCurves[0].push_back(Point(300, 100));
+    polyCurves[0].push_back(Point(300, 220));
+    polyCurves[0].push_back(Point(100, 220));
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    Detect grid(PALM_GRID);
+    Detect dt(PALM_DISTANCE_TRANSFORM);
+    std::pair<Point, double> expected = grid.findMaxInscribedCircle(polyCurves, frame);
+    std::pair<Point, double> actual = dt.findMaxInscribedCircle(polyCurves, frame);
+    ASSERT_TRUE(abs(expected.second - actual.second) <= 2);
+    ASSERT_TRUE(abs(expected.first.y - actual.first.y) <= 10);
+}
+
+TEST(Detect, findMaxInscribedCircleCoarseToFine) {
+    vector<vector<Point>> polyCurves(1);
+    polyCurves[0].push_back(Point(100, 100));
+    polyCurves[0].push_back(Point(300, 100));
+    polyCurves[0].push_back(Point(300, 220));
+    polyCurves[0].push_back(Point(100, 220));
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    Detect grid(PALM_GRID);
+    Detect c2f(PALM_COARSE_TO_FINE);
+    std::pair<Point, double> expected = grid.findMaxInscribedCircle(polyCurves, frame);
+    std::pair<Point, double> actual = c2f.findMaxInscribedCircle(polyCurves, frame);
+    ASSERT_EQ(expected.second, actual.second);
+    ASSERT_EQ(160, actual.first.y);
+    ASSERT_TRUE(c2f.polygonTests() * 10 < grid.polygonTests());
+
+    // the second frame starts from the first frame's palm
+    int coarse = c2f.polygonTests();
+    actual = c2f.findMaxInscribedCircle(polyCurves, frame);
+    ASSERT_EQ(expected.second, actual.second);
+    ASSERT_TRUE(c2f.polygonTests() < coarse);
+}
+
+// a palm with a finger, the way getPolyCurves would give it, at the pyramid level given
+static vector<Point> handPolygon(int level = 0) {
+    int points[8][2] = {
+        { 200, 200 }, { 260, 200 }, { 260, 60 }, { 300, 60 },
+        { 300, 200 }, { 360, 200 }, { 360, 360 }, { 200, 360 }
+    };
+
+    vector<Point> polygon;
+    for (int i = 0; i < 8; ++i) {
+        polygon.push_back(Point(points[i][0] >> level, points[i][1] >> level));
+    }
+    return polygon;
+}
+
+// a mask of the size given with the hand of handPolygon filled in, the way Preprocess leaves it
+static Mat handMask(const Size& size, int level = 0) {
+    vector<Point> polygon = handPolygon(level);
+    Mat mask = Mat::zeros(size, CV_8U);
+    const Point* points = &polygon[0];
+    int count = (int)polygon.size();
+    fillPoly(mask, &points, &count, 1, Scalar(255));
+    return mask;
+}
+
+TEST(Detect, steadyStateAllocations) {
+    // the steps of findHand that are ours, without the OpenCV calls between
+    // them, which allocate scratch of their own
+    vector<vector<Point>> polyCurves(1, handPolygon());
+
+    vector<Vec4i> defects;
+    defects.push_back(Vec4i(1, 2, 0, 10 * 256));
+    defects.push_back(Vec4i(3, 5, 4, 40 * 256));
+
+    vector<Point> defectEnds;
+    defectEnds.push_back(Point(270, 60));
+    defectEnds.push_back(Point(290, 60));
+
+    Mat raw = Mat::zeros(480, 640, CV_8UC3);
+    Detect d(PALM_COARSE_TO_FINE);
+
+    // the first frames size the workspace, after which these allocate nothing
+    for (int frame = 0; frame < 5; ++frame) {
+        if (frame == 3) {
+            allocations = 0;
+            countingAllocations = true;
+        }
+
+        std::pair<Point, double> maxCircle = d.findMaxInscribedCircle(polyCurves, raw);
+        d._pointPool.clear(d._goodPolyCurves);
+        d.getRegionOfInterest(d._goodPolyCurves, polyCurves, maxCircle);
+        d.findMinEnclosingCircle(d._goodPolyCurves);
+        d.getConvexHulls(d._goodPolyCurves);
+        d.filterDefects(defects);
+        d.findFingerTips(defectEnds, maxCircle);
+    }
+    countingAllocations = false;
+
+    ASSERT_EQ(0, allocations.load());
+    ASSERT_EQ(1, d._hand.defects.size());
+    ASSERT_EQ(1, d._hand.tips.size());
+}
+
+// where every buffer of the workspace of a detector, and of the detectors of
+// its hands, keeps its data. A buffer that moves was allocated again
+static void detectWorkspace(const Detect& d, vector<const void*>& buffers) {
+    buffers.push_back(d._palmMask.data);
+    buffers.push_back(d._palmDist.data);
+    buffers.push_back(d._tipWindow.data);
+    buffers.push_back(d._contours.data());
+
+    const vector<vector<Point>>* pooled[] = { &d._polyCurves, &d._goodPolyCurves, &d._hullPoints };
+    for (int i = 0; i < 3; ++i) {
+        buffers.push_back(pooled[i]->data());
+        for (size_t j = 0; j < pooled[i]->size(); ++j) {
+            buffers.push_back((*pooled[i])[j].data());
+        }
+    }
+    buffers.push_back(d._hullIndices.data());
+    for (size_t i = 0; i < d._hullIndices.size(); ++i) {
+        buffers.push_back(d._hullIndices[i].data());
+    }
+
+    buffers.push_back(d._defects.data());
+    buffers.push_back(d._defectEnds.data());
+    buffers.push_back(d._endCells.data());
+    buffers.push_back(d._nearestEnd.data());
+    buffers.push_back(d._hand.contour.data());
+    buffers.push_back(d._hand.hull.data());
+    buffers.push_back(d._hand.defects.data());
+    buffers.push_back(d._hand.tips.data());
+
+    buffers.push_back(d._hands.data());
+    for (size_t i = 0; i < d._hands.size(); ++i) {
+        buffers.push_back(d._hands[i].contour.data());
+        buffers.push_back(d._hands[i].hull.data());
+        buffers.push_back(d._hands[i].tips.data());
+    }
+    for (size_t i = 0; i < d._handDetectors.size(); ++i) {
+        buffers.push_back(d._handDetectors[i]);
+        detectWorkspace(*d._handDetectors[i], buffers);
+    }
+}
+
+TEST(Detect, steadyStateWorkspace) {
+    // two hands at half resolution, moving a pixel every frame, which moves
+    // their contours without changing their size
+    Mat hand = handMask(Size(200, 200), 1);
+    Detect d(PALM_DISTANCE_TRANSFORM, 2);
+    d.setPyramidLevel(1);
+
+    vector<const void*> sized;
+    for (int frame = 0; frame < 8; ++frame) {
+        Mat mask = Mat::zeros(240, 320, CV_8U);
+        hand.copyTo(mask(Rect(frame, frame, 200, 200)));
+        rectangle(mask, Rect(240, 150 + frame, 60, 60), Scalar(255), -1);
+
+        // everything HandMade does with a mask, up to full resolution hands
+        Mat contours = mask.clone();
+        vector<Hand> hands = d.findHands(contours);
+        ASSERT_EQ(2, hands.size());
+        for (size_t i = 0; i < hands.size(); ++i) {
+            d.toFullResolution(hands[i], mask);
+        }
+
+        // the first frames size the workspace, after which it is only reused
+        vector<const void*> buffers;
+        detectWorkspace(d, buffers);
+        if (frame == 2) {
+            sized = buffers;
+        }
+        else if (frame > 2) {
+            ASSERT_EQ(sized, buffers);
+        }
+    }
+}
+
+TEST(Detect, operatorFindsHand) {
+    Mat mask = handMask(Size(640, 480));
+
+    Detect d;
+    const Hand& hand = d(mask);
+    ASSERT_TRUE(abs(hand.palm.second - 81) <= 1);
+    ASSERT_TRUE(hand.enclosing.second > hand.palm.second);
+    ASSERT_FALSE(hand.contour.empty());
+    ASSERT_FALSE(hand.hull.empty());
+    ASSERT_TRUE(hand.hull.size() <= hand.contour.size());
+    ASSERT_TRUE(hand.totalMs >= hand.contourMs);
+}
+
+TEST(Detect, findHandsLargestFirst) {
+    // the hand, with a smaller square one off to its left
+    Mat mask = handMask(Size(640, 480));
+    rectangle(mask, Rect(20, 380, 80, 80), Scalar(255), -1);
+
+    Detect d(PALM_DISTANCE_TRANSFORM, 2);
+    Mat frame = mask.clone();
+    const vector<Hand>& hands = d.findHands(frame);
+    ASSERT_EQ(2, hands.size());
+    ASSERT_TRUE(abs(hands[0].palm.second - 81) <= 1);
+    ASSERT_TRUE(abs(hands[1].palm.second - 40) <= 1);
+    ASSERT_TRUE(hands[1].palm.first.x < 100);
+    ASSERT_FALSE(hands[1].contour.empty());
+
+    // a detector after a single hand only gets the largest
+    Detect single(PALM_DISTANCE_TRANSFORM, 1);
+    frame = mask.clone();
+    const vector<Hand>& largest = single.findHands(frame);
+    ASSERT_EQ(1, largest.size());
+    ASSERT_TRUE(abs(largest[0].palm.second - 81) <= 1);
+}
+
+TEST(Detect, findHandsFollowsHands) {
+    // two hands, the larger on the right
+    Mat mask = Mat::zeros(480, 640, CV_8U);
+    rectangle(mask, Rect(40, 160, 160, 160), Scalar(255), -1);
+    rectangle(mask, Rect(300, 100, 240, 240), Scalar(255), -1);
+
+    Detect d(PALM_COARSE_TO_FINE, 2);
+    Mat frame = mask.clone();
+    ASSERT_EQ(2, d.findHands(frame).size());
+    Detect* left = d._handDetectors[1];
+    ASSERT_TRUE(left->_lastPalm.first.x < 200);
+
+    // the left hand grows past the right one, its detector goes with it
+    rectangle(mask, Rect(20, 100, 260, 260), Scalar(255), -1);
+    frame = mask.clone();
+    const vector<Hand>& hands = d.findHands(frame);
+    ASSERT_EQ(2, hands.size());
+    ASSERT_EQ(left, d._handDetectors[0]);
+    ASSERT_TRUE(hands[0].palm.first.x < 280);
+    ASSERT_TRUE(abs(hands[0].palm.second - 130) <= 2);
+    ASSERT_TRUE(abs(hands[1].palm.second - 120) <= 2);
+}
+
+TEST(Detect, pyramidLevel) {
+    // the hand at half resolution, and a square that is too small for a hand
+    // at full resolution but not once it stands for four times the pixels
+    Mat mask = handMask(Size(320, 240), 1);
+    rectangle(mask, Rect(10, 170, 60, 60), Scalar(255), -1);
+
+    Detect full(PALM_DISTANCE_TRANSFORM, 2);
+    Mat frame = mask.clone();
+    ASSERT_EQ(1, full.findHands(frame).size());
+
+    Detect half(PALM_DISTANCE_TRANSFORM, 2);
+    half.setPyramidLevel(1);
+    ASSERT_EQ(1, half.pyramidLevel());
+    frame = mask.clone();
+    vector<Hand> hands = half.findHands(frame);
+    ASSERT_EQ(2, hands.size());
+    ASSERT_TRUE(abs(hands[0].palm.second - 40) <= 1);
+
+    // back at full resolution the hand is the size of the full resolution one
+    half.toFullResolution(hands[0], mask);
+    ASSERT_TRUE(abs(hands[0].palm.second - 80) <= 2);
+    ASSERT_TRUE(abs(hands[0].palm.first.x - 280) <= 4);
+    ASSERT_TRUE(abs(hands[0].palm.first.y - 280) <= 4);
+    ASSERT_TRUE(hands[0].enclosing.second > hands[0].palm.second);
+}
+
+TEST(Detect, toFullResolutionRefinesTips) {
+    // a finger at half resolution, ending on row 50, and a tip found a row short of it
+    Mat mask = Mat::zeros(240, 320, CV_8U);
+    rectangle(mask, Rect(100, 50, 11, 100), Scalar(255), -1);
+
+    Hand hand;
+    hand.palm = std::make_pair(Point(105, 200), 30.0);
+    hand.enclosing = std::make_pair(Point2f(105, 150), 60.0f);
+    hand.tips.push_back(Point(105, 51));
+
+    Detect d;
+    d.toFullResolution(hand, mask);
+    ASSERT_EQ(hand.tips[0], Point(105, 51));
+
+    d.setPyramidLevel(1);
+    d.toFullResolution(hand, mask);
+    ASSERT_EQ(hand.palm.first, Point(210, 400));
+    ASSERT_EQ(60, hand.palm.second);
+    ASSERT_EQ(120, hand.enclosing.second);
+
+    // the end of the finger is on row 100 at full resolution, and the row
+    // above it is half covered once the mask is interpolated
+    ASSERT_EQ(99, hand.tips[0].y);
+    ASSERT_TRUE(abs(hand.tips[0].x - 210) <= 4);
+}
+
+TEST(Visualizer, disabled) {
+    Hand hand;
+    hand.palm = std::make_pair(Point(50, 50), 20.0);
+    hand.enclosing = std::make_pair(Point2f(50, 50), 40.0f);
+    hand.tips.push_back(Point(50, 5));
+
+    Mat frame = Mat::zeros(100, 100, CV_8UC3);
+    Visualizer visualizer(false);
+    visualizer.draw(frame, hand);
+    ASSERT_EQ(0, countNonZero(frame.reshape(1)));
+
+    visualizer.setEnabled(true);
+    visualizer.draw(frame, hand);
+#ifdef HEADLESS
+    ASSERT_EQ(0, countNonZero(frame.reshape(1)));
+#else
+    ASSERT_TRUE(countNonZero(frame.reshape(1)) > 0);
+#endif
+}
+
 TEST(Detect, findMinEnclosingCircle) {
     vector<vector<Point>> polyCurves;
     Detect d;
@@ -120,9 +484,8 @@ TEST(Detect, findMinEnclosingCircle) {
 TEST(Detect, findFingerTips) {
     vector<Point> defectEnds;
     std::pair<Point, double> maxCircle;
-    Mat frame = imread("TestHand.png");
     Detect d;
-    vector<Point> a = d.findFingerTips(defectEnds, maxCircle, frame);
+    vector<Point> a = d.findFingerTips(defectEnds, maxCircle);
     vector<Point> b;
     for(int i = 0; i < b.size(); ++i) {
         Point actual = a[i];
@@ -132,6 +495,47 @@ TEST(Detect, findFingerTips) {
     }
 }
 
+TEST(Detect, findFingerTipsPairsNearest) {
+    Detect d;
+    std::pair<Point, double> maxCircle(Point(100, 300), 40);
+
+    // the first end under half the palm radius from (118, 100) is (100, 100),
+    // but both of them are nearest to (104, 100)
+    vector<Point> defectEnds;
+    defectEnds.push_back(Point(118, 100));
+    defectEnds.push_back(Point(100, 100));
+    defectEnds.push_back(Point(104, 100));
+
+    const vector<Point>& tips = d.findFingerTips(defectEnds, maxCircle);
+    ASSERT_EQ(1, tips.size());
+    ASSERT_EQ(Point(102, 100), tips[0]);
+}
+
+TEST(Detect, findFingerTipsManyEnds) {
+    Detect d;
+    std::pair<Point, double> maxCircle(Point(300, 600), 40);
+
+    // five fingers, two ends each
+    vector<Point> defectEnds;
+    for (int i = 0; i < 5; ++i) {
+        defectEnds.push_back(Point(100 + 60 * i, 100));
+        defectEnds.push_back(Point(108 + 60 * i, 100));
+    }
+
+    // and the hundreds of lone ends a noisy contour leaves
+    for (int y = 0; y < 15; ++y) {
+        for (int x = 0; x < 20; ++x) {
+            defectEnds.push_back(Point(1000 + 50 * x, 50 * y));
+        }
+    }
+
+    const vector<Point>& tips = d.findFingerTips(defectEnds, maxCircle);
+    ASSERT_EQ(5, tips.size());
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQ(Point(104 + 60 * i, 100), tips[i]);
+    }
+}
+
 TEST(Detect, filterDefects) {
     vector<Vec4i> defects;
     Detect d;
@@ -147,6 +551,19 @@ TEST(Detect, filterDefects) {
     }
 }
 
+TEST(Detect, filterDefectsAtPyramidLevel) {
+    // depths are fixed point with 8 fractional bits, a quarter resolution
+    // pixel is 4 full resolution ones, so 5.75 is 23 and 5 is 20
+    vector<Vec4i> defects;
+    defects.push_back(Vec4i(0, 1, 2, 5 * 256 + 192));
+    defects.push_back(Vec4i(3, 4, 5, 5 * 256));
+
+    Detect d;
+    d.setPyramidLevel(2);
+    const vector<Vec4i>& actual = d.filterDefects(defects);
+    ASSERT_EQ(1, actual.size());
+    ASSERT_EQ(0, actual[0][0]);
+}
 
 TEST(Detect, getPolyCurves1) {
     Mat frame = imread("TestHand1.png");
@@ -203,9 +620,8 @@ TEST(Detect, findMinEnclosingCircle1) {
 TEST(Detect, findFingerTips1) {
     vector<Point> defectEnds;
     std::pair<Point, double> maxCircle;
-    Mat frame = imread("TestHand1.png");
     Detect d;
-    vector<Point> a = d.findFingerTips(defectEnds, maxCircle, frame);
+    vector<Point> a = d.findFingerTips(defectEnds, maxCircle);
     vector<Point> b;
     for(int i = 0; i < b.size(); ++i) {
         Point actual = a[i];
@@ -241,5 +657,1160 @@ TEST(Preprocess, thresholdFilter) {
 TEST(Preprocess, faceDetection) {
 }
 
-TEST(HandMade, getBackground) {
+TEST(Preprocess, pyramidLevel) {
+    // a wall with an odd size, and a hand in front of it
+    Mat background(241, 321, CV_8UC3);
+    randn(background, Scalar::all(110), Scalar::all(6));
+    Mat frame = background.clone();
+    rectangle(frame, Rect(100, 80, 100, 120), Scalar(48, 70, 111), -1);
+    rectangle(frame, Rect(130, 20, 25, 60), Scalar(48, 70, 111), -1);
+
+    Preprocess p(background, "");
+    int area = countNonZero(p(frame) > 127);
+    ASSERT_TRUE(area > 10000);
+
+    // every level halves the size, rounding up, and keeps about as much of the hand
+    p.setPyramidLevel(1);
+    ASSERT_EQ(1, p.pyramidLevel());
+    const Mat& half = p(frame);
+    ASSERT_EQ(Size(161, 121), half.size());
+    ASSERT_TRUE(abs(countNonZero(half > 127) * 4 - area) < area / 10);
+
+    p.setPyramidLevel(2);
+    const Mat& quarter = p(frame);
+    ASSERT_EQ(Size(81, 61), quarter.size());
+    ASSERT_TRUE(abs(countNonZero(quarter > 127) * 16 - area) < area / 5);
+
+    // the region of interest stays in full resolution coordinates
+    p.setRegionOfInterest(Rect(90, 10, 130, 200));
+    const Mat& roi = p(frame);
+    ASSERT_EQ(Size(81, 61), roi.size());
+    ASSERT_EQ(0, countNonZero(roi.colRange(0, 20)));
+    ASSERT_TRUE(countNonZero(roi > 127) > 0);
+
+    p.setPyramidLevel(5);
+    ASSERT_EQ(2, p.pyramidLevel());
+}
+
+// where every image of the workspace of Preprocess keeps its data. An image
+// that moves was allocated again
+static void preprocessWorkspace(const Preprocess& p, vector<const void*>& buffers) {
+    const Mat* images[] = { &p._levels[0], &p._levels[1], &p._ycrcb, &p._raw,
+                            &p._planes[0], &p._planes[1], &p._planes[2], &p._mask, &p._output };
+    for (int i = 0; i < 9; ++i) {
+        buffers.push_back(images[i]->data);
+    }
+
+    for (int i = 0; i < 3; ++i) {
+        const SquareOpen& open = p._open[i];
+        for (size_t j = 0; j < open._eroded.size(); ++j) {
+            buffers.push_back(open._eroded[j].data);
+        }
+        for (size_t j = 0; j < open._scratch.size(); ++j) {
+            buffers.push_back(open._scratch[j].data);
+        }
+    }
+}
+
+TEST(Preprocess, steadyStateWorkspace) {
+    // a hand moving a pixel every frame in front of a noisy wall, at half
+    // resolution inside a region of interest, which exercises every image
+    Mat background(241, 321, CV_8UC3);
+    randn(background, Scalar::all(110), Scalar::all(6));
+
+    Preprocess p(background, "");
+    p.setPyramidLevel(1);
+    p.setRegionOfInterest(Rect(64, 0, 192, 192));
+
+    vector<const void*> sized;
+    Mat frame(241, 321, CV_8UC3);
+    for (int i = 0; i < 8; ++i) {
+        randn(frame, Scalar::all(110), Scalar::all(6));
+        rectangle(frame, Rect(100 + i, 80, 100, 100), Scalar(48, 70, 111), -1);
+        rectangle(frame, Rect(130 + i, 20, 25, 60), Scalar(48, 70, 111), -1);
+        ASSERT_TRUE(countNonZero(p(frame) > 127) > 0);
+
+        // the first frames size the images, after which they are only reused
+        vector<const void*> buffers;
+        preprocessWorkspace(p, buffers);
+        if (i == 2) {
+            sized = buffers;
+        }
+        else if (i > 2) {
+            ASSERT_EQ(sized, buffers);
+        }
+    }
+}
+
+TEST(Segment, thresholdDifference) {
+    // odd width so both the vector and the scalar kernels run
+    Mat frame(7, 203, CV_8UC3), bg(7, 203, CV_8UC3);
+    randu(frame, Scalar::all(0), Scalar::all(256));
+    randu(bg, Scalar::all(0), Scalar::all(256));
+
+    Mat diff, expected[3];
+    subtract(frame, bg, diff);
+    split(diff, expected);
+    threshold(expected[0], expected[0], 20, 255, THRESH_BINARY);
+    threshold(expected[1], expected[1], 100, 255, THRESH_BINARY);
+
+    Mat actual[3];
+    thresholdDifference(frame, bg, Scalar(20, 100, -1), actual);
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_EQ(0, norm(expected[i], actual[i], NORM_INF));
+    }
+}
+
+TEST(Segment, skinMask) {
+    Mat raw(7, 203, CV_8UC3);
+    randu(raw, Scalar::all(0), Scalar::all(256));
+
+    // push every third pixel into the skin range so both outcomes are covered
+    Mat skinny(7, 203, CV_8UC3);
+    randu(skinny, Scalar(0, 128, 70), Scalar(256, 180, 135));
+    for (int i = 0; i < raw.rows; ++i) {
+        for (int j = 0; j < raw.cols; j += 3) {
+            raw.at<Vec3b>(i, j) = skinny.at<Vec3b>(i, j);
+        }
+    }
+
+    Mat planes[3];
+    for (int i = 0; i < 3; ++i) {
+        planes[i].create(raw.size(), CV_8U);
+        randu(planes[i], Scalar(0), Scalar(2));
+        planes[i] *= 255;
+    }
+    Scalar minYCrCb(0, 133, 77), maxYCrCb(255, 173, 127);
+
+    // the chain Preprocess used before
+    Mat merged, expected, skinRegion;
+    merge(planes, 3, merged);
+    bitwise_and(merged, raw, expected);
+    cvtColor(expected, expected, CV_YCrCb2BGR);
+    cvtColor(expected, expected, CV_BGR2GRAY);
+    threshold(expected, expected, 120, 255, THRESH_BINARY_INV);
+    inRange(raw, minYCrCb, maxYCrCb, skinRegion);
+    compare(expected, skinRegion, expected, CMP_EQ);
+
+    Mat actual;
+    skinMask(planes, raw, minYCrCb, maxYCrCb, actual);
+    ASSERT_EQ(0, norm(expected, actual, NORM_INF));
+}
+
+TEST(SquareOpen, matchesMorphologyEx) {
+    Mat element = getStructuringElement(MORPH_RECT, Size(3, 3));
+
+    // a tall plane that gets several stripes, a short one that gets a single
+    // stripe, and a gray one, all of odd widths
+    Mat planes[3];
+    planes[0].create(301, 203, CV_8U);
+    planes[1].create(9, 37, CV_8U);
+    planes[2].create(97, 131, CV_8U);
+    for (int i = 0; i < 2; ++i) {
+        randu(planes[i], Scalar(0), Scalar(2));
+        planes[i] *= 255;
+    }
+    randu(planes[2], Scalar::all(0), Scalar::all(256));
+
+    for (int iterations = 1; iterations <= 3; ++iterations) {
+        SquareOpen open(2 * iterations + 1);
+        Mat expected[3], actual[3];
+        for (int i = 0; i < 3; ++i) {
+            morphologyEx(planes[i], expected[i], MORPH_OPEN, element, Point(-1, -1), iterations);
+            actual[i] = planes[i].clone();
+        }
+
+        open(actual, 3);
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_EQ(0, norm(expected[i], actual[i], NORM_INF));
+        }
+
+        // an open is idempotent, so a second one changes nothing
+        open(actual, 3);
+        for (int i = 0; i < 3; ++i) {
+            ASSERT_EQ(0, norm(expected[i], actual[i], NORM_INF));
+        }
+    }
+}
+
+TEST(FaceTracker, missingCascade) {
+    FaceTracker faces("missing.xml");
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    ASSERT_FALSE(faces.isLoaded());
+    ASSERT_EQ(0, faces(frame).size());
+}
+
+TEST(FaceTracker, noFaces) {
+    FaceTracker faces("frontal_face.xml", 1, 0.5);
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    ASSERT_TRUE(faces.isLoaded());
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_EQ(0, faces(frame).size());
+    }
+}
+
+TEST(FaceTracker, retriesWhenBusy) {
+    FaceTracker faces("frontal_face.xml", 5, 0.5);
+    Mat frame = Mat::zeros(480, 640, CV_8UC3);
+    ASSERT_TRUE(faces.isLoaded());
+
+    // the worker is busy when the detection falls due on frame 0
+    {
+        std::lock_guard<std::mutex> lock(faces._mutex);
+        faces._busy = true;
+    }
+    faces(frame);
+    ASSERT_TRUE(faces._due);
+
+    // so it goes with frame 1, rather than waiting for frame 5
+    {
+        std::lock_guard<std::mutex> lock(faces._mutex);
+        faces._busy = false;
+    }
+    faces(frame);
+    ASSERT_FALSE(faces._due);
+
+    std::lock_guard<std::mutex> lock(faces._mutex);
+    ASSERT_EQ(1, faces._pendingFrame);
+}
+
+TEST(Background, warmup) {
+    Background bg(3, 0.5);
+    Mat frame(4, 4, CV_8UC3, Scalar(10, 20, 30));
+    for (int i = 0; i < 3; ++i) {
+        ASSERT_FALSE(bg.isReady());
+        bg.update(frame);
+    }
+    ASSERT_TRUE(bg.isReady());
+    Mat actual = bg.background();
+    ASSERT_EQ(frame.type(), actual.type());
+    ASSERT_EQ(0, norm(actual, frame, NORM_INF));
+}
+
+TEST(Background, warmupAverages) {
+    Background bg(2, 0.5);
+    bg.update(Mat(2, 2, CV_8UC3, Scalar(10, 10, 10)));
+    bg.update(Mat(2, 2, CV_8UC3, Scalar(30, 30, 30)));
+    Mat actual = bg.background();
+    ASSERT_EQ(20, actual.at<Vec3b>(0, 0)[0]);
+}
+
+TEST(Background, skipsHand) {
+    Background bg(1, 0.5);
+    bg.update(Mat(2, 2, CV_8UC3, Scalar(100, 100, 100)));
+
+    Mat hand = Mat::zeros(2, 2, CV_8U);
+    hand.at<uchar>(0, 0) = 255;
+    bg.update(Mat(2, 2, CV_8UC3, Scalar(200, 200, 200)), hand);
+
+    Mat actual = bg.background();
+    ASSERT_EQ(100, actual.at<Vec3b>(0, 0)[0]);
+    ASSERT_EQ(150, actual.at<Vec3b>(1, 1)[0]);
+}
+
+TEST(Background, skipsHandAtPyramidLevel) {
+    Background bg(1, 0.5);
+    bg.update(Mat(4, 4, CV_8UC3, Scalar(100, 100, 100)));
+
+    // a mask at half the resolution of the frame
+    Mat hand = Mat::zeros(2, 2, CV_8U);
+    hand.at<uchar>(0, 0) = 255;
+    bg.update(Mat(4, 4, CV_8UC3, Scalar(200, 200, 200)), hand);
+
+    Mat actual = bg.background();
+    ASSERT_EQ(100, actual.at<Vec3b>(0, 0)[0]);
+    ASSERT_EQ(150, actual.at<Vec3b>(3, 3)[0]);
+}
+
+TEST(RoiTracker, lost) {
+    RoiTracker tracker;
+    std::pair<Point, double> maxCircle;
+    std::pair<Point2f, float> minCircle;
+    Rect actual = tracker.update(maxCircle, minCircle, Size(640, 480));
+    ASSERT_FALSE(tracker.isTracking());
+    ASSERT_EQ(Rect(0, 0, 640, 480), actual);
+}
+
+TEST(RoiTracker, tracking) {
+    RoiTracker tracker(1.5, 40);
+    std::pair<Point, double> maxCircle(Point(320, 240), 30);
+    std::pair<Point2f, float> minCircle(Point2f(320, 200), 80);
+    Rect actual = tracker.update(maxCircle, minCircle, Size(640, 480));
+    ASSERT_TRUE(tracker.isTracking());
+    ASSERT_EQ(Rect(192, 72, 256, 256), actual);
+}
+
+TEST(RoiTracker, shifted) {
+    RoiTracker tracker(1.5, 40);
+    std::pair<Point, double> maxCircle(Point(20, 20), 30);
+    std::pair<Point2f, float> minCircle(Point2f(10, 10), 80);
+    Rect actual = tracker.update(maxCircle, minCircle, Size(640, 480));
+    ASSERT_EQ(Rect(0, 0, 256, 256), actual);
+}
+
+TEST(RoiTracker, severalHands) {
+    // a second hand could come in anywhere, so the full frame is kept
+    RoiTracker tracker(1.5, 40);
+    tracker.setMaxHands(2);
+    std::pair<Point, double> maxCircle(Point(320, 240), 30);
+    std::pair<Point2f, float> minCircle(Point2f(320, 200), 80);
+    Rect actual = tracker.update(maxCircle, minCircle, Size(640, 480));
+    ASSERT_FALSE(tracker.isTracking());
+    ASSERT_EQ(Rect(0, 0, 640, 480), actual);
+
+    tracker.setMaxHands(1);
+    actual = tracker.update(maxCircle, minCircle, Size(640, 480));
+    ASSERT_EQ(Rect(192, 72, 256, 256), actual);
+}
+
+TEST(Pipeline, inOrder) {
+    int captured = 0;
+    Pipeline pipeline(
+        [&](PipelineFrame& f) { return captured++ < 50; },
+        [](PipelineFrame& f) { f.hand.palm.second = f.index; },
+        [](PipelineFrame& f) { f.hand.tips.assign(1, Point(f.index, 0)); },
+        1, DROP_NONE);
+
+    PipelineFrame* f;
+    int expected = 0;
+    while (pipeline.next(f)) {
+        ASSERT_EQ(expected, f->index);
+        ASSERT_EQ(expected, f->hand.palm.second);
+        ASSERT_EQ(expected, f->hand.tips[0].x);
+        ++expected;
+        pipeline.release(f);
+    }
+    ASSERT_EQ(50, expected);
+    ASSERT_EQ(0, pipeline.dropped());
+}
+
+TEST(Pipeline, dropOldest) {
+    int captured = 0;
+    Pipeline pipeline(
+        [&](PipelineFrame& f) { return captured++ < 50; },
+        [](PipelineFrame& f) {},
+        [](PipelineFrame& f) {},
+        1, DROP_OLDEST);
+
+    // a slow consumer makes the queues drop, but never reorder
+    PipelineFrame* f;
+    int last = -1;
+    int delivered = 0;
+    while (pipeline.next(f)) {
+        ASSERT_TRUE(f->index > last);
+        last = f->index;
+        ++delivered;
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        pipeline.release(f);
+    }
+
+    // the newest frame is never dropped
+    ASSERT_EQ(49, last);
+    ASSERT_EQ(50, delivered + pipeline.dropped());
+    ASSERT_TRUE(pipeline.dropped() > 0);
+}
+
+TEST(Recorder, writesImages) {
+    Recorder recorder;
+    ASSERT_FALSE(recorder.write(Mat::zeros(4, 4, CV_8U), 0));
+
+    ASSERT_TRUE(recorder.open("TestRecorder_%d.png", 8, 2));
+    for (int i = 998; i < 1002; ++i) {
+        Mat frame(4, 4, CV_32F, Scalar(i - 900));
+        ASSERT_TRUE(recorder.write(frame, i));
+    }
+    recorder.close();
+    ASSERT_EQ(4, recorder.written());
+    ASSERT_EQ(0, recorder.dropped());
+
+    // the names grow past three digits, and the float frames come out 8 bit
+    Mat actual = imread("TestRecorder_1001.png", CV_LOAD_IMAGE_GRAYSCALE);
+    ASSERT_EQ(101, actual.at<uchar>(0, 0));
+    for (int i = 998; i < 1002; ++i) {
+        std::ostringstream name;
+        name << "TestRecorder_" << i << ".png";
+        remove(name.str().c_str());
+    }
+}
+
+TEST(Recorder, dropsWhenFull) {
+    Recorder recorder;
+    recorder.open("TestRecorder_drop_%d.png", 1, 1);
+
+    // the caller never waits, every frame is either written or dropped
+    Mat frame(480, 640, CV_8UC3, Scalar(1, 2, 3));
+    for (int i = 0; i < 20; ++i) {
+        recorder.write(frame, i);
+    }
+    recorder.close();
+    ASSERT_EQ(20, recorder.written() + recorder.dropped());
+    ASSERT_TRUE(recorder.written() > 0);
+
+    for (int i = 0; i < 20; ++i) {
+        std::ostringstream name;
+        name << "TestRecorder_drop_" << i << ".png";
+        remove(name.str().c_str());
+    }
+}
+
+TEST(Canvas, matchesWhiteboard) {
+    Canvas canvas(Size(640, 480));
+    Mat expected = Mat::zeros(480, 640, CV_8U);
+
+    line(expected, Point(10, 10), Point(300, 200), Scalar(255), 3);
+    line(expected, Point(300, 200), Point(320, 470), Scalar(255), 3);
+    line(expected, Point(600, 20), Point(5, 400), Scalar(255), 3);
+    circle(expected, Point(200, 150), 40, Scalar(0), -1);
+
+    canvas.line(Point(10, 10), Point(300, 200), 3);
+    canvas.line(Point(300, 200), Point(320, 470), 3);
+    canvas.line(Point(600, 20), Point(5, 400), 3);
+    canvas.erase(Point(200, 150), 40);
+
+    const Mat& actual = canvas.render();
+    ASSERT_EQ(0, norm(actual, expected, NORM_INF));
+
+    // only the tiles with ink on them exist
+    ASSERT_TRUE(canvas.tiles() < 70);
+    ASSERT_EQ(0, canvas.dirtyTiles());
+}
+
+TEST(Canvas, sparse) {
+    Canvas canvas(Size(640, 480), 64);
+    ASSERT_EQ(0, canvas.tiles());
+
+    // far off the view, where a dense board could not draw at all
+    canvas.line(Point(-100000, 50000), Point(-99990, 50000), 3);
+    ASSERT_EQ(1, canvas.tiles());
+    ASSERT_EQ(1, canvas.dirtyTiles());
+    ASSERT_EQ(0, countNonZero(canvas.render()));
+
+    // erasing everything frees the tile again
+    canvas.erase(Point(-99995, 50000), 20);
+    ASSERT_EQ(0, canvas.tiles());
+}
+
+TEST(Canvas, viewport) {
+    Canvas canvas(Size(200, 200), 64);
+    canvas.line(Point(100, 100), Point(110, 100), 3);
+    canvas.render();
+
+    // moving the view right moves the ink left
+    canvas.pan(Point2f(50, 0));
+    const Mat& panned = canvas.render();
+    ASSERT_EQ(255, panned.at<uchar>(100, 55));
+    ASSERT_EQ(0, panned.at<uchar>(100, 105));
+    ASSERT_EQ(Point(100, 100), canvas.toBoard(Point(50, 100)));
+
+    // zooming keeps the anchor in place and scales the rest
+    canvas.setViewport(Point2f(0, 0), 1);
+    canvas.zoom(2, Point(100, 100));
+    const Mat& zoomed = canvas.render();
+    ASSERT_EQ(255, zoomed.at<uchar>(100, 100));
+    ASSERT_EQ(255, zoomed.at<uchar>(100, 118));
+    ASSERT_EQ(Point(105, 100), canvas.toBoard(Point(110, 100)));
+}
+
+TEST(StrokeLog, roundTrip) {
+    StrokeLog log;
+    ASSERT_TRUE(log.open("TestStrokeLog.strokes"));
+    log.line(Point(10, 10), Point(14, 12), 3, 0);
+    log.line(Point(14, 12), Point(-3, 90000), 5, 40);
+    log.erase(Point(-200, -300), 60, 1040);
+    log.close();
+
+    StrokeReader reader;
+    StrokeEvent event;
+    ASSERT_TRUE(reader.open("TestStrokeLog.strokes"));
+
+    ASSERT_TRUE(reader.next(event));
+    ASSERT_EQ(STROKE_LINE, event.type);
+    ASSERT_EQ(Point(10, 10), event.from);
+    ASSERT_EQ(Point(14, 12), event.to);
+    ASSERT_EQ(3, event.size);
+
+    ASSERT_TRUE(reader.next(event));
+    ASSERT_EQ(Point(-3, 90000), event.to);
+    ASSERT_EQ(40, event.time);
+
+    ASSERT_TRUE(reader.next(event));
+    ASSERT_EQ(STROKE_ERASE, event.type);
+    ASSERT_EQ(Point(-200, -300), event.from);
+    ASSERT_EQ(60, event.size);
+    ASSERT_EQ(1040, event.time);
+
+    ASSERT_FALSE(reader.next(event));
+    reader.close();
+    remove("TestStrokeLog.strokes");
+}
+
+TEST(StrokeLog, replayMatchesCanvas) {
+    Canvas drawn(Size(640, 480));
+    StrokeLog log;
+    log.open("TestStrokeLog_replay.strokes");
+
+    // a wandering stroke, each segment starting where the last one ended
+    Point prev(320, 240);
+    for (int i = 0; i < 500; ++i) {
+        Point next(prev.x + (i * 7) % 13 - 6, prev.y + (i * 5) % 11 - 5);
+        drawn.line(prev, next, 3);
+        log.line(prev, next, 3, i * 33);
+        prev = next;
+    }
+    drawn.erase(Point(320, 240), 30);
+    log.erase(Point(320, 240), 30, 500 * 33);
+    log.close();
+
+    // a handful of bytes per stroke, rather than a frame of pixels
+    ASSERT_TRUE(log.bytes() < 500 * 8);
+
+    Canvas replayed(Size(640, 480));
+    ASSERT_EQ(501, replayStrokes("TestStrokeLog_replay.strokes", replayed));
+    ASSERT_EQ(0, norm(drawn.render(), replayed.render(), NORM_INF));
+    remove("TestStrokeLog_replay.strokes");
+}
+
+TEST(StrokeLog, truncated) {
+    StrokeLog log;
+    log.open("TestStrokeLog_cut.strokes");
+    log.line(Point(0, 0), Point(100, 100), 3, 0);
+    log.line(Point(100, 100), Point(200, 50), 3, 10);
+    log.close();
+
+    // cut the last record short, as a crash in the middle of a write would
+    std::vector<uchar> bytes(log.bytes());
+    FILE* file = fopen("TestStrokeLog_cut.strokes", "rb");
+    ASSERT_EQ(bytes.size(), fread(&bytes[0], 1, bytes.size(), file));
+    fclose(file);
+    remove("TestStrokeLog_cut.strokes");
+
+    StrokeReader reader;
+    StrokeEvent event;
+    ASSERT_TRUE(reader.open(&bytes[0], bytes.size() - 1));
+    ASSERT_TRUE(reader.next(event));
+    ASSERT_FALSE(reader.next(event));
+
+    // a file that is not a stroke log at all is refused
+    bytes[0] = 'X';
+    ASSERT_FALSE(reader.open(&bytes[0], bytes.size()));
+    Canvas canvas(Size(64, 64));
+    ASSERT_EQ(-1, replayStrokes("TestStrokeLog_missing.strokes", canvas));
+}
+
+TEST(TipFilter, oneEuroSmooths) {
+    TipFilter filter(TIP_FILTER_ONE_EURO);
+    ASSERT_FALSE(filter.isStarted());
+
+    // a resting tip, jittering by two pixels either way
+    double worst = 0;
+    for (int i = 0; i < 60; ++i) {
+        Point2f measured(100 + (i % 2 ? 2 : -2), 200 + (i % 3 - 1) * 2);
+        Point2f filtered = filter.update(measured, i / 30.0);
+        if (i > 10) {
+            worst = std::max(worst, (double)std::max(std::abs(filtered.x - 100), std::abs(filtered.y - 200)));
+        }
+    }
+    ASSERT_TRUE(filter.isStarted());
+    ASSERT_TRUE(worst < 1);
+}
+
+TEST(TipFilter, kalmanPredicts) {
+    TipFilter filter(TIP_FILTER_KALMAN);
+
+    // a tip moving right at 300 pixels a second
+    for (int i = 0; i < 30; ++i) {
+        filter.update(Point2f(100 + 10 * i, 200), i / 30.0);
+    }
+    ASSERT_NEAR(300, filter.velocity().x, 15);
+    ASSERT_NEAR(0, filter.velocity().y, 1);
+
+    // where it will be two frames later
+    ASSERT_NEAR(410, filter.predict(2 / 30.0).x, 3);
+
+    // predict never looks more than maxAhead past the last measurement
+    ASSERT_NEAR(filter.predict(0.1).x, filter.predict(5).x, 1e-3);
+}
+
+TEST(TipFilter, restartsAfterGap) {
+    TipFilter filter(TIP_FILTER_KALMAN, 0.25);
+    filter.update(Point2f(0, 0), 0);
+    filter.update(Point2f(10, 0), 0.1);
+
+    // a tip seen again after a long gap is a new one, at rest
+    Point2f filtered = filter.update(Point2f(500, 300), 1.0);
+    ASSERT_EQ(Point2f(500, 300), filtered);
+    ASSERT_EQ(Point2f(0, 0), filter.velocity());
+
+    // without an engine the tips are passed straight through
+    TipFilter none(TIP_FILTER_NONE);
+    none.update(Point2f(1, 1), 0);
+    ASSERT_EQ(Point2f(7, 9), none.update(Point2f(7, 9), 0.03));
+}
+
+TEST(TipTracker, assignIsOptimal) {
+    TipTracker tracker;
+
+    // greedily taking the cheapest pair first (row 0 to column 0) costs 1 + 9,
+    // the best assignment costs 2 + 3
+    double cost[] = { 1, 2,
+                      3, 9 };
+    tracker._cost.assign(cost, cost + 4);
+    tracker.assign(2);
+    ASSERT_EQ(1, tracker._assignment[0]);
+    ASSERT_EQ(0, tracker._assignment[1]);
+}
+
+TEST(TipTracker, stableIds) {
+    TipTracker tracker(60, 3, 5, 10);
+
+    // two fingers passing each other, each found twice as Detect does
+    for (int i = 0; i < 30; ++i) {
+        vector<Point> tips;
+        tips.push_back(Point(100 + 5 * i, 100));
+        tips.push_back(Point(101 + 5 * i, 101));
+        tips.push_back(Point(300 - 5 * i, 130));
+        tips.push_back(Point(299 - 5 * i, 131));
+
+        const vector<TipTrack>& tracks = tracker.update(tips, i / 30.0);
+        ASSERT_EQ(2, tracks.size());
+        ASSERT_EQ(i >= 2, tracks[0].confirmed);
+    }
+
+    const TipTrack* left = tracker.find(0);
+    const TipTrack* right = tracker.find(1);
+    ASSERT_TRUE(left && right);
+    ASSERT_NEAR(245, left->filter.position().x, 5);
+    ASSERT_NEAR(155, right->filter.position().x, 5);
+}
+
+TEST(TipTracker, hysteresis) {
+    TipTracker tracker(60, 3, 2, 10);
+    vector<Point> tips(1, Point(200, 200));
+    vector<Point> none;
+
+    // a tip seen once is not trusted, and is forgotten as soon as it is missed
+    tracker.update(tips, 0);
+    ASSERT_TRUE(tracker.oldest() == 0);
+    tracker.update(none, 0.03);
+    ASSERT_EQ(0, tracker.tracks().size());
+
+    for (int i = 0; i < 3; ++i) {
+        tracker.update(tips, 0.1 + i * 0.03);
+    }
+    const TipTrack* finger = tracker.oldest();
+    ASSERT_TRUE(finger != 0);
+    int id = finger->id;
+
+    // a confirmed tip outlives two missed frames, but not a third
+    tracker.update(none, 0.2);
+    tracker.update(none, 0.23);
+    ASSERT_TRUE(tracker.find(id) != 0);
+    ASSERT_TRUE(tracker.oldest() == 0);
+    tracker.update(tips, 0.26);
+    ASSERT_EQ(id, tracker.oldest()->id);
+
+    tracker.update(none, 0.3);
+    tracker.update(none, 0.33);
+    tracker.update(none, 0.36);
+    ASSERT_TRUE(tracker.find(id) == 0);
+}
+
+// the features of a frame with a hand holding up the fingers given
+static GestureFeatures handFeatures(int fingers, float x, float y) {
+    GestureFeatures features;
+    features.time = 0;
+    features.fingers = fingers;
+    features.palm = Point2f(x, y + 100);
+    features.palmRadius = 40;
+    features.pointer = Point2f(x, y);
+    return features;
+}
+
+TEST(Gesture, pointStartsAndMoves) {
+    GestureRecognizer gestures;
+
+    ASSERT_EQ(0, gestures.update(handFeatures(1, 100, 100)).size());
+    ASSERT_EQ(GESTURE_NONE, gestures.active());
+
+    const vector<GestureEvent>& started = gestures.update(handFeatures(1, 110, 100));
+    ASSERT_EQ(1, started.size());
+    ASSERT_EQ(GESTURE_START, started[0].type);
+    ASSERT_EQ(GESTURE_POINT, started[0].gesture);
+    ASSERT_EQ(Point2f(110, 100), started[0].position);
+
+    const vector<GestureEvent>& moved = gestures.update(handFeatures(1, 120, 105));
+    ASSERT_EQ(1, moved.size());
+    ASSERT_EQ(GESTURE_MOVE, moved[0].type);
+    ASSERT_EQ(Point2f(10, 5), moved[0].delta);
+}
+
+TEST(Gesture, ignoresFlicker) {
+    GestureRecognizer gestures;
+    for (int i = 0; i < 5; ++i) {
+        gestures.update(handFeatures(1, 100, 100));
+    }
+
+    // a frame with every finger found, and one with the hand lost
+    GestureFeatures lost = handFeatures(0, 0, 0);
+    lost.palmRadius = 0;
+    GestureFeatures frames[] = { handFeatures(5, 100, 100), handFeatures(1, 100, 100),
+                                 lost, handFeatures(1, 100, 100), handFeatures(2, 100, 100) };
+
+    for (int i = 0; i < 5; ++i) {
+        const vector<GestureEvent>& events = gestures.update(frames[i]);
+        for (size_t j = 0; j < events.size(); ++j) {
+            ASSERT_EQ(GESTURE_MOVE, events[j].type);
+        }
+        ASSERT_EQ(GESTURE_POINT, gestures.active());
+    }
+}
+
+TEST(Gesture, zoom) {
+    GestureRecognizer gestures;
+    for (int i = 0; i < 6; ++i) {
+        gestures.update(handFeatures(5, 200, 200));
+    }
+    ASSERT_EQ(GESTURE_OPEN_PALM, gestures.active());
+
+    // closing the hand zooms out around the palm, once
+    int zooms = 0;
+    for (int i = 0; i < 6; ++i) {
+        const vector<GestureEvent>& events = gestures.update(handFeatures(0, 200, 200));
+        for (size_t j = 0; j < events.size(); ++j) {
+            if (events[j].type == GESTURE_ZOOM) {
+                ++zooms;
+                ASSERT_EQ(0.8, events[j].scale);
+                ASSERT_EQ(Point2f(200, 300), events[j].position);
+            }
+        }
+    }
+    ASSERT_EQ(1, zooms);
+    ASSERT_EQ(GESTURE_FIST, gestures.active());
+
+    // and opening it zooms back in
+    double scale = 1;
+    for (int i = 0; i < 6; ++i) {
+        const vector<GestureEvent>& events = gestures.update(handFeatures(4, 200, 200));
+        for (size_t j = 0; j < events.size(); ++j) {
+            if (events[j].type == GESTURE_ZOOM) {
+                scale *= events[j].scale;
+            }
+        }
+    }
+    ASSERT_EQ(1.25, scale);
+    ASSERT_EQ(GESTURE_OPEN_PALM, gestures.active());
+}
+
+TEST(Gesture, steadyStateAllocations) {
+    GestureRecognizer gestures;
+    int fingers[] = { 1, 1, 2, 5, 5, 5, 5, 0, 0, 0, 0, 3, 1, 1, 4 };
+
+    allocations = 0;
+    countingAllocations = true;
+    for (int i = 0; i < 300; ++i) {
+        gestures.update(handFeatures(fingers[i % 15], i, 100));
+    }
+    countingAllocations = false;
+
+    ASSERT_EQ(0, allocations.load());
+    ASSERT_TRUE(GestureRecognizer::rule(GESTURE_NONE) == 0);
+    ASSERT_EQ(1, GestureRecognizer::rule(GESTURE_POINT)->minFingers);
+}
+
+// the events traced on this thread under the name given
+static int tracedOnThisThread(const std::vector<TraceEvent>& events, const char* name, int thread)
+{
+    int count = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (events[i].thread == thread && strcmp(events[i].name, name) == 0) {
+            ++count;
+        }
+    }
+    return count;
+}
+
+TEST(Trace, scopes) {
+    std::vector<TraceEvent> events;
+
+    // switched off, a scope records nothing
+    setTracing(false);
+    clearTrace();
+    {
+        TraceScope trace("test.off");
+    }
+    traceEvent("test.first", 1, 2);
+    traceEvents(events);
+    ASSERT_EQ(1, events.size());
+    int thread = events[0].thread;
+    ASSERT_EQ(0, tracedOnThisThread(events, "test.off", thread));
+
+    // a run of stages leaves no gaps
+    setTracing(true);
+    clearTrace();
+    {
+        TraceScope trace("test.a");
+        trace.next("test.b");
+    }
+    setTracing(false);
+    traceEvents(events);
+    ASSERT_EQ(2, events.size());
+    ASSERT_STREQ("test.a", events[0].name);
+    ASSERT_STREQ("test.b", events[1].name);
+    ASSERT_LE(events[0].start, events[0].end);
+    ASSERT_EQ(events[0].end, events[1].start);
+    ASSERT_LE(events[1].start, events[1].end);
+}
+
+TEST(Trace, ringKeepsNewest) {
+    clearTrace();
+    for (int i = 0; i < 20000; ++i) {
+        traceEvent("test.wrap", i, i + 1);
+    }
+
+    std::vector<TraceEvent> events;
+    traceEvents(events);
+    ASSERT_GT(events.size(), 1000);
+    ASSERT_LT(events.size(), 20000);
+    ASSERT_EQ(19999, events.back().start);
+    for (size_t i = 1; i < events.size(); ++i) {
+        ASSERT_EQ(events[i - 1].start + 1, events[i].start);
+    }
+}
+
+TEST(Trace, threads) {
+    clearTrace();
+    traceEvent("test.main", 0, 1);
+
+    // read while the other thread records, every event read has to be whole
+    std::thread worker([]() {
+        for (int i = 0; i < 50000; ++i) {
+            traceEvent("test.worker", i, i + 1);
+        }
+    });
+    std::vector<TraceEvent> events;
+    for (int i = 0; i < 20; ++i) {
+        traceEvents(events);
+        for (size_t j = 0; j < events.size(); ++j) {
+            ASSERT_EQ(events[j].start + 1, events[j].end);
+        }
+    }
+    worker.join();
+
+    traceEvents(events);
+    int mainThread = -1, workerThread = -1;
+    for (size_t i = 0; i < events.size(); ++i) {
+        (strcmp(events[i].name, "test.main") == 0 ? mainThread : workerThread) = events[i].thread;
+    }
+    ASSERT_NE(-1, mainThread);
+    ASSERT_NE(-1, workerThread);
+    ASSERT_NE(mainThread, workerThread);
+    ASSERT_EQ(49999, events.back().start);
+}
+
+TEST(Trace, output) {
+    clearTrace();
+    traceEvent("test.a", 0, 10);
+    traceEvent("test.b", 10, 30);
+
+    ASSERT_TRUE(writeChromeTrace("TestTrace.json"));
+    std::ifstream in("TestTrace.json");
+    std::stringstream json;
+    json << in.rdbuf();
+    remove("TestTrace.json");
+
+    ASSERT_EQ(0, json.str().find("{\"traceEvents\":["));
+    ASSERT_NE(std::string::npos, json.str().find("{\"name\":\"test.a\",\"ph\":\"X\""));
+    ASSERT_NE(std::string::npos, json.str().find("\"name\":\"test.b\""));
+
+    // the summary covers the events since the last one
+    std::ostringstream summary;
+    printTraceSummary(summary);
+    ASSERT_NE(std::string::npos, summary.str().find("test.b"));
+
+    std::ostringstream next;
+    printTraceSummary(next);
+    ASSERT_EQ(std::string::npos, next.str().find("test.b"));
+}
+
+TEST(Corpus, maskHash) {
+    Mat mask = Mat::zeros(48, 64, CV_8U);
+    circle(mask, Point(30, 20), 10, Scalar(255), -1);
+
+    // a view hashes the same as a copy
+    Mat frame = Mat::zeros(100, 100, CV_8U);
+    mask.copyTo(frame(Rect(10, 10, 64, 48)));
+    ASSERT_EQ(maskHash(mask), maskHash(frame(Rect(10, 10, 64, 48))));
+
+    Mat changed = mask.clone();
+    changed.at<uchar>(47, 63) = 1;
+    ASSERT_NE(maskHash(mask), maskHash(changed));
+}
+
+TEST(Corpus, compare) {
+    GoldenFrame expected;
+    expected.read = true;
+    expected.maskHash = 1;
+    expected.maskArea = 10000;
+    expected.palm = Point(100, 100);
+    expected.radius = 40;
+    expected.tips.push_back(Point(100, 20));
+    expected.tips.push_back(Point(60, 30));
+
+    GoldenTolerance tolerance;
+    GoldenFrame actual = expected;
+    ASSERT_EQ("", compareGolden(expected, actual, tolerance));
+
+    // the tips can come back in any order and move a little
+    std::swap(actual.tips[0], actual.tips[1]);
+    actual.tips[0].x += 2;
+    actual.palm.y += 1;
+    actual.maskHash = 2;
+    ASSERT_EQ("", compareGolden(expected, actual, tolerance));
+
+    tolerance.exactMask = true;
+    ASSERT_EQ("mask changed", compareGolden(expected, actual, tolerance));
+    tolerance.exactMask = false;
+
+    actual.maskArea = 10100;
+    actual.tips.pop_back();
+    ASSERT_EQ("mask area 10000 -> 10100, 2 tips -> 1", compareGolden(expected, actual, tolerance));
+
+    actual = expected;
+    actual.radius = 0;
+    ASSERT_EQ("hand lost", compareGolden(expected, actual, tolerance));
+
+    actual.read = false;
+    ASSERT_EQ("could not be read", compareGolden(expected, actual, tolerance));
+}
+
+TEST(Corpus, matchesGolden) {
+    // the seed corpus, a hand with none to four fingers up in front of a
+    // wall, against the reference checked in with it
+    Corpus corpus("corpus");
+    ASSERT_TRUE(corpus.load());
+    ASSERT_EQ(9, corpus.frames().size());
+
+    std::vector<GoldenFrame> results;
+    ASSERT_TRUE(corpus.run(results));
+
+    GoldenTolerance tolerance;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const GoldenFrame& frame = corpus.frames()[i];
+        ASSERT_EQ("", compareGolden(frame, results[i], tolerance)) << frame.file;
+    }
+}
+
+TEST(Corpus, recordAndRun) {
+    // a wall, and the same wall with a hand in front of it in a few places
+    Mat background(240, 320, CV_8UC3);
+    randn(background, Scalar::all(110), Scalar::all(6));
+    imwrite("TestCorpus_background.png", background);
+
+    for (int i = 0; i < 6; ++i) {
+        Mat frame = background.clone();
+        rectangle(frame, Rect(60 + 20 * i, 80, 100, 120), Scalar(120, 150, 200), -1);
+        rectangle(frame, Rect(90 + 20 * i, 20, 25, 60), Scalar(120, 150, 200), -1);
+        std::ostringstream name;
+        name << "TestCorpus_" << i << ".png";
+        imwrite(name.str(), frame);
+    }
+
+    Corpus recorded(".");
+    recorded.setBackground("TestCorpus_background.png");
+    ASSERT_EQ(6, recorded.addFrames("TestCorpus_%d.png"));
+
+    std::vector<GoldenFrame> results;
+    ASSERT_TRUE(recorded.run(results));
+    ASSERT_EQ(6, results.size());
+    recorded.setFrames(results);
+    ASSERT_TRUE(recorded.save());
+
+    // the reference reads back as it was written, and a second run, chunked
+    // differently over the threads, matches it to the bit
+    Corpus corpus(".");
+    ASSERT_TRUE(corpus.load());
+    ASSERT_EQ(6, corpus.frames().size());
+
+    GoldenTolerance exact;
+    exact.palm = exact.radius = exact.tip = exact.maskArea = 0;
+    exact.exactMask = true;
+
+    int threads = getNumThreads();
+    setNumThreads(1);
+    ASSERT_TRUE(corpus.run(results));
+    setNumThreads(threads);
+
+    for (int i = 0; i < 6; ++i) {
+        const GoldenFrame& frame = corpus.frames()[i];
+        ASSERT_TRUE(frame.read);
+        ASSERT_EQ(results[i].maskHash, frame.maskHash);
+        ASSERT_EQ(results[i].tips.size(), frame.tips.size());
+        ASSERT_EQ("", compareGolden(frame, results[i], exact));
+    }
+
+    // at half resolution the frames are just as independent of each other
+    std::vector<GoldenFrame> half;
+    Config halfConfig;
+    halfConfig.pyramidLevel = 1;
+    corpus.setConfig(halfConfig);
+    ASSERT_TRUE(corpus.run(half));
+    setNumThreads(1);
+    ASSERT_TRUE(corpus.run(results));
+    setNumThreads(threads);
+
+    for (int i = 0; i < 6; ++i) {
+        const GoldenFrame& frame = corpus.frames()[i];
+        ASSERT_TRUE(half[i].read);
+        ASSERT_EQ(0, half[i].maskArea % 4);
+        ASSERT_EQ("", compareGolden(half[i], results[i], exact));
+        remove(("./" + frame.file).c_str());
+    }
+    remove("TestCorpus_background.png");
+    remove("golden.yml");
+}
+
+TEST(Config, defaults) {
+    // the defaults are the constants the pipeline was tuned with
+    Config config;
+    ASSERT_EQ("default", config.profile);
+    ASSERT_EQ(Size(640, 480), config.frameSize);
+    ASSERT_EQ(0, config.pyramidLevel);
+    ASSERT_EQ(PALM_DISTANCE_TRANSFORM, config.palmEngine);
+    ASSERT_EQ(1, config.maxHands);
+
+    ASSERT_EQ(Scalar(0, 133, 77), config.preprocess.minYCrCb);
+    ASSERT_EQ(Scalar(255, 173, 127), config.preprocess.maxYCrCb);
+    ASSERT_EQ(7, config.preprocess.blurSize);
+    ASSERT_EQ(1.8, config.preprocess.blurSigma);
+    ASSERT_EQ(3, config.preprocess.openIterations);
+    ASSERT_EQ(Scalar::all(-1), config.preprocess.channelThresholds);
+
+    ASSERT_EQ(5000, config.detect.minContourArea);
+    ASSERT_EQ(2.0, config.detect.polyEpsilon);
+    ASSERT_EQ(10, config.detect.gridStep);
+    ASSERT_EQ(3.5, config.detect.regionRadii);
+    ASSERT_EQ(20, config.detect.minDefectDepth);
+    ASSERT_EQ(0.5, config.detect.tipPairing);
+
+    ASSERT_EQ(60, config.draw.tipMaxDistance);
+    ASSERT_EQ(10, config.draw.tipDedupeRadius);
+    ASSERT_EQ(200, config.draw.strokeBreak);
+
+    // and Preprocess opens with the 7x7 square they add up to
+    Preprocess p(Mat::zeros(8, 8, CV_8UC3), "", config.preprocess);
+    ASSERT_EQ(7, p._open[0].size());
+    ASSERT_EQ(5, p._open[1].size());
+    ASSERT_EQ(3, p._open[2].size());
+}
+
+TEST(Config, presets) {
+    Config config;
+    ASSERT_TRUE(applyPreset("low-latency", config));
+    ASSERT_EQ("low-latency", config.profile);
+    ASSERT_EQ(1, config.pyramidLevel);
+    ASSERT_EQ(1, config.maxHands);
+
+    // a preset starts from the defaults
+    ASSERT_TRUE(applyPreset("1080p", config));
+    ASSERT_EQ(Size(1920, 1080), config.frameSize);
+    ASSERT_EQ(2, config.pyramidLevel);
+    ASSERT_EQ(PALM_DISTANCE_TRANSFORM, config.palmEngine);
+
+    ASSERT_TRUE(applyPreset("accurate", config));
+    ASSERT_TRUE(config.detect.polyEpsilon < DetectConfig().polyEpsilon);
+    ASSERT_EQ(PALM_DISTANCE_TRANSFORM, config.palmEngine);
+
+    ASSERT_FALSE(applyPreset("fastest", config));
+    ASSERT_EQ("accurate", config.profile);
+}
+
+TEST(Config, roundTrip) {
+    Config config;
+    applyPreset("low-latency", config);
+    config.preprocess.minYCrCb = Scalar(10, 130, 70);
+    config.preprocess.channelThresholds = Scalar(20, -1, -1);
+    config.detect.minContourArea = 3000;
+    config.draw.strokeBreak = 150;
+    config.palmEngine = PALM_GRID;
+    ASSERT_TRUE(saveConfig("TestConfig.yml", config));
+
+    Config loaded;
+    ASSERT_TRUE(loadConfig("TestConfig.yml", loaded));
+    ASSERT_EQ("low-latency", loaded.profile);
+    ASSERT_EQ(1, loaded.pyramidLevel);
+    ASSERT_EQ(PALM_GRID, loaded.palmEngine);
+    ASSERT_EQ(Scalar(10, 130, 70), loaded.preprocess.minYCrCb);
+    ASSERT_EQ(Scalar(20, -1, -1), loaded.preprocess.channelThresholds);
+    ASSERT_EQ(3000, loaded.detect.minContourArea);
+    ASSERT_EQ(config.detect.gridStep, loaded.detect.gridStep);
+    ASSERT_EQ(150, loaded.draw.strokeBreak);
+    ASSERT_EQ(config.draw.tipMaxDistance, loaded.draw.tipMaxDistance);
+    remove("TestConfig.yml");
+
+    // a file only holds what it changes, over the profile it names
+    std::ofstream file("TestConfig.yml");
+    file << "%YAML:1.0\nprofile: \"1080p\"\nmaxHands: 2\ndetect:\n   gridStep: 4\n";
+    file.close();
+
+    ASSERT_TRUE(loadConfig("TestConfig.yml", loaded));
+    ASSERT_EQ("1080p", loaded.profile);
+    ASSERT_EQ(Size(1920, 1080), loaded.frameSize);
+    ASSERT_EQ(2, loaded.maxHands);
+    ASSERT_EQ(4, loaded.detect.gridStep);
+    ASSERT_EQ(5000, loaded.detect.minContourArea);
+
+    // and an unknown profile leaves the settings alone
+    file.open("TestConfig.yml");
+    file << "%YAML:1.0\nprofile: \"fastest\"\nmaxHands: 3\n";
+    file.close();
+
+    ASSERT_FALSE(loadConfig("TestConfig.yml", loaded));
+    ASSERT_EQ(2, loaded.maxHands);
+    remove("TestConfig.yml");
+
+    ASSERT_FALSE(loadConfig("TestConfigMissing.yml", loaded));
+}
+
+TEST(Config, scaleDetectConfig) {
+    DetectConfig detect;
+    DetectConfig same = scaleDetectConfig(detect, Size(640, 480));
+    ASSERT_EQ(detect.minContourArea, same.minContourArea);
+    ASSERT_EQ(detect.gridStep, same.gridStep);
+
+    DetectConfig hd = scaleDetectConfig(detect, Size(1920, 1080));
+    ASSERT_NEAR(5000 * 2.25 * 2.25, hd.minContourArea, 1e-6);
+    ASSERT_NEAR(2.0 * 2.25, hd.polyEpsilon, 1e-9);
+    ASSERT_TRUE(abs(hd.gridStep - 22.5) <= 0.5);
+    ASSERT_NEAR(20 * 2.25, hd.minDefectDepth, 1e-9);
+    ASSERT_EQ(detect.regionRadii, hd.regionRadii);
+    ASSERT_EQ(detect.tipPairing, hd.tipPairing);
+}
+
+TEST(Config, scaleDrawConfig) {
+    DrawConfig draw;
+    DrawConfig same = scaleDrawConfig(draw, Size(640, 480));
+    ASSERT_EQ(draw.tipMaxDistance, same.tipMaxDistance);
+    ASSERT_EQ(draw.strokeBreak, same.strokeBreak);
+
+    // the tips are followed as far, relative to the hand, at 1080p
+    DrawConfig hd = scaleDrawConfig(draw, Size(1920, 1080));
+    ASSERT_NEAR(60 * 2.25, hd.tipMaxDistance, 1e-9);
+    ASSERT_NEAR(10 * 2.25, hd.tipDedupeRadius, 1e-9);
+    ASSERT_NEAR(200 * 2.25, hd.strokeBreak, 1e-9);
+}
+
+TEST(Config, detectUsesConfig) {
+    // a hand too small for the default area cutoff, but not for a lower one
+    Mat mask = Mat::zeros(240, 320, CV_8U);
+    rectangle(mask, Rect(100, 100, 60, 60), Scalar(255), -1);
+
+    Detect d;
+    Mat frame = mask.clone();
+    ASSERT_EQ(0, d.findHands(frame).size());
+
+    DetectConfig config;
+    config.minContourArea = 2000;
+    Detect lower(PALM_DISTANCE_TRANSFORM, 2, config);
+    frame = mask.clone();
+    ASSERT_EQ(1, lower.findHands(frame).size());
 }
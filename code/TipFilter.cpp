@@ -0,0 +1,236 @@
+#include "TipFilter.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * the weight a low pass filter with the cutoff given, in hertz, puts on a
+ * new sample dt seconds after the last one
+ */
+
+static double smoothing(double dt, double cutoff)
+{
+    double tau = 1.0 / (2 * CV_PI * cutoff);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+/**
+ * The constructor for TipFilter
+ *
+ * maxGap is the longest time, in seconds, between two measurements of the
+ * same tip, and maxAhead caps how far predict extrapolates. The defaults
+ * are tuned for a 640x480 camera at 15 to 30 frames per second
+ */
+
+TipFilter::TipFilter(TipFilterEngine engine, double maxGap, double maxAhead) :
+    _engine(engine),
+    _started(false),
+    _lastTime(0),
+    _maxGap(maxGap),
+    _maxAhead(maxAhead),
+    _minCutoff(1.0),
+    _beta(0.05),
+    _velocityCutoff(1.0),
+    _processNoise(1e4),
+    _measurementNoise(9)
+{
+    reset();
+}
+
+/**
+ * The destructor for TipFilter
+ *
+ * As of now this does nothing
+ */
+
+TipFilter::~TipFilter()
+{}
+
+/**
+ * Tunes the one euro filter
+ *
+ * A lower minCutoff smooths a resting tip more, a higher beta lets a moving
+ * tip lag less
+ */
+
+void TipFilter::setOneEuro(double minCutoff, double beta, double velocityCutoff)
+{
+    _minCutoff = minCutoff;
+    _beta = beta;
+    _velocityCutoff = velocityCutoff;
+}
+
+/**
+ * Tunes the Kalman filter
+ *
+ * processNoise is how much the tip is expected to accelerate and
+ * measurementNoise how far Detect's tips scatter, so a higher ratio follows
+ * the measurements more closely
+ */
+
+void TipFilter::setKalman(double processNoise, double measurementNoise)
+{
+    _processNoise = processNoise;
+    _measurementNoise = measurementNoise;
+}
+
+/**
+ * A step of the one euro filter
+ *
+ * The velocity is a low passed difference of measurements, and its speed sets
+ * the cutoff for the position. Both axes share the cutoff so a diagonal
+ * stroke is not bent
+ */
+
+void TipFilter::oneEuro(const Point2f& measured, double dt)
+{
+    double z[2] = { measured.x, measured.y };
+    double a = smoothing(dt, _velocityCutoff);
+
+    for (int i = 0; i < 2; ++i) {
+        double last = i == 0 ? _lastMeasured.x : _lastMeasured.y;
+        _velocity[i] += a * ((z[i] - last) / dt - _velocity[i]);
+    }
+
+    double speed = std::sqrt(_velocity[0] * _velocity[0] + _velocity[1] * _velocity[1]);
+    a = smoothing(dt, _minCutoff + _beta * speed);
+
+    for (int i = 0; i < 2; ++i) {
+        _position[i] += a * (z[i] - _position[i]);
+    }
+}
+
+/**
+ * A step of the Kalman filter
+ *
+ * Each axis is a position and velocity driven by white noise acceleration,
+ * which is what cv::KalmanFilter would do with a 4x4 state, but with the
+ * axes independent every matrix is 2x2 and is written out by hand
+ */
+
+void TipFilter::kalman(const Point2f& measured, double dt)
+{
+    double z[2] = { measured.x, measured.y };
+    double q = _processNoise;
+
+    for (int i = 0; i < 2; ++i) {
+        double& pp = _covariance[i][0];
+        double& pv = _covariance[i][1];
+        double& vv = _covariance[i][2];
+
+        // predict
+        _position[i] += _velocity[i] * dt;
+        pp += dt * (2 * pv + dt * vv) + q * dt * dt * dt / 3;
+        pv += dt * vv + q * dt * dt / 2;
+        vv += q * dt;
+
+        // correct
+        double s = pp + _measurementNoise;
+        double kp = pp / s;
+        double kv = pv / s;
+        double innovation = z[i] - _position[i];
+
+        _position[i] += kp * innovation;
+        _velocity[i] += kv * innovation;
+
+        vv -= kv * pv;
+        pv -= kp * pv;
+        pp -= kp * pp;
+    }
+}
+
+/**
+ * Adds a measurement and returns the filtered tip
+ *
+ * time is when the frame was captured, in seconds. The first measurement,
+ * and the first after a gap longer than _maxGap, is taken as it is, with the
+ * tip at rest
+ */
+
+Point2f TipFilter::update(const Point2f& measured, double time)
+{
+    double dt = time - _lastTime;
+
+    if (!_started || dt > _maxGap || _engine == TIP_FILTER_NONE) {
+        reset();
+        _position[0] = measured.x;
+        _position[1] = measured.y;
+        _lastMeasured = measured;
+        _started = true;
+        _lastTime = time;
+        return position();
+    }
+
+    // two tips from the same frame, or a clock going backwards
+    dt = std::max(dt, 1e-3);
+
+    if (_engine == TIP_FILTER_KALMAN) {
+        kalman(measured, dt);
+    }
+    else {
+        oneEuro(measured, dt);
+    }
+
+    _lastMeasured = measured;
+    _lastTime = time;
+    return position();
+}
+
+/**
+ * Returns where the tip will be the number of seconds given after the last
+ * measurement, carried on at its current velocity
+ *
+ * The time is capped at _maxAhead, so a stale tip does not fly off
+ */
+
+Point2f TipFilter::predict(double ahead) const
+{
+    double t = std::min(std::max(ahead, 0.0), _maxAhead);
+    return Point2f((float)(_position[0] + _velocity[0] * t), (float)(_position[1] + _velocity[1] * t));
+}
+
+/**
+ * Returns the filtered tip
+ */
+
+Point2f TipFilter::position() const
+{
+    return Point2f((float)_position[0], (float)_position[1]);
+}
+
+/**
+ * Returns the filtered velocity, in pixels per second
+ */
+
+Point2f TipFilter::velocity() const
+{
+    return Point2f((float)_velocity[0], (float)_velocity[1]);
+}
+
+/**
+ * Forgets the tip
+ *
+ * The Kalman filter starts out sure of the first position, to within the
+ * measurement noise, and unsure of the velocity
+ */
+
+void TipFilter::reset()
+{
+    _started = false;
+    for (int i = 0; i < 2; ++i) {
+        _position[i] = 0;
+        _velocity[i] = 0;
+        _covariance[i][0] = _measurementNoise;
+        _covariance[i][1] = 0;
+        _covariance[i][2] = 1e6;
+    }
+}
+
+/**
+ * Returns whether the filter is following a tip
+ */
+
+bool TipFilter::isStarted() const
+{
+    return _started;
+}
@@ -0,0 +1,106 @@
+#ifndef TIPFILTER_H
+#define TIPFILTER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+// the ways a TipFilter can smooth a finger tip
+enum TipFilterEngine {
+    // the measurements are passed through as they are
+    TIP_FILTER_NONE,
+
+    // a low pass filter whose cutoff rises with the speed of the tip, so a
+    // resting tip is smoothed hard and a moving one barely lags
+    TIP_FILTER_ONE_EURO,
+
+    // a constant velocity Kalman filter on each axis
+    TIP_FILTER_KALMAN
+};
+
+/**
+ * The TipFilter class
+ *
+ * This follows a single finger tip from frame to frame, smoothing out the
+ * jitter in where Detect finds it and estimating how fast it is moving
+ *
+ * Every measurement is given with the time its frame was captured, so frames
+ * the pipeline dropped only make the step longer. The velocity lets predict
+ * say where the tip is by now, once the frame has made its way through the
+ * pipeline, which hides most of the pipeline's latency from the drawing.
+ * After a gap longer than maxGap the tip is taken to be a new one and the
+ * filter starts again from the measurement
+ */
+
+using namespace cv;
+
+class TipFilter
+{
+    private:
+        TipFilterEngine _engine;
+
+        // false until the first measurement, and again after reset
+        bool _started;
+
+        // the capture time of the last measurement, in seconds
+        double _lastTime;
+
+        // the longest gap between measurements that is still the same tip, in seconds
+        double _maxGap;
+
+        // the furthest predict looks ahead, in seconds
+        double _maxAhead;
+
+        // the filtered position and velocity on each axis, in pixels and pixels per second
+        double _position[2];
+        double _velocity[2];
+
+        // the last measurement, which the one euro filter's velocity is taken from
+        Point2f _lastMeasured;
+
+        // the one euro filter's cutoff at rest and its growth with speed, and the
+        // cutoff for the velocity, in hertz
+        double _minCutoff;
+        double _beta;
+        double _velocityCutoff;
+
+        // the Kalman filter's acceleration noise and measurement noise, and the
+        // covariance of position and velocity on each axis
+        double _processNoise;
+        double _measurementNoise;
+        double _covariance[2][3];
+
+        // a step of each engine, dt seconds after the last measurement
+        void oneEuro(const Point2f& measured, double dt);
+        void kalman(const Point2f& measured, double dt);
+
+    public:
+        TipFilter(TipFilterEngine engine = TIP_FILTER_ONE_EURO, double maxGap = 0.25, double maxAhead = 0.1);
+        ~TipFilter();
+
+        // tunes the one euro filter, the cutoffs in hertz and beta in hertz per pixel per second
+        void setOneEuro(double minCutoff, double beta, double velocityCutoff = 1.0);
+
+        // tunes the Kalman filter, in pixels squared per second cubed and pixels squared
+        void setKalman(double processNoise, double measurementNoise);
+
+        // adds a measurement taken at the capture time given, in seconds, and returns the filtered tip
+        Point2f update(const Point2f& measured, double time);
+
+        // where the tip will be the number of seconds given after the last measurement
+        Point2f predict(double ahead) const;
+
+        // the filtered tip and its velocity in pixels per second
+        Point2f position() const;
+        Point2f velocity() const;
+
+        // forgets the tip, the next measurement starts the filter afresh
+        void reset();
+
+        // true once a measurement has been added since the last reset
+        bool isStarted() const;
+};
+
+#endif // TIPFILTER_H
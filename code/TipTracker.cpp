@@ -0,0 +1,284 @@
+#include "TipTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+/**
+ * The constructor for TipTracker
+ *
+ * maxDistance is how far, in pixels, a tip can be from where its track
+ * expected it, birthFrames how many frames in a row a new tip has to be seen
+ * in before its track is confirmed, deathFrames how many frames a confirmed
+ * track can go without its tip, and dedupeRadius how close two tips are
+ * before they are taken to be the same finger. Every track smooths its tip
+ * with a TipFilter using the engine given
+ */
+
+TipTracker::TipTracker(double maxDistance, int birthFrames, int deathFrames,
+                       double dedupeRadius, TipFilterEngine engine) :
+    _maxDistance(maxDistance),
+    _birthFrames(birthFrames),
+    _deathFrames(deathFrames),
+    _dedupeRadius(dedupeRadius),
+    _engine(engine),
+    _nextId(0)
+{}
+
+/**
+ * The destructor for TipTracker
+ *
+ * As of now this does nothing
+ */
+
+TipTracker::~TipTracker()
+{}
+
+/**
+ * Merges the tips closer together than the dedupe radius
+ *
+ * Each tip joins the first merged tip within the radius, which moves to the
+ * mean of the tips in it
+ */
+
+void TipTracker::dedupe(const std::vector<Point>& tips)
+{
+    _merged.clear();
+    _weights.clear();
+
+    for (size_t i = 0; i < tips.size(); ++i) {
+        Point2f tip((float)tips[i].x, (float)tips[i].y);
+        size_t j = 0;
+
+        for (; j < _merged.size(); ++j) {
+            float dx = _merged[j].x - tip.x;
+            float dy = _merged[j].y - tip.y;
+            if (dx * dx + dy * dy <= _dedupeRadius * _dedupeRadius) {
+                break;
+            }
+        }
+
+        if (j == _merged.size()) {
+            _merged.push_back(tip);
+            _weights.push_back(1);
+        }
+        else {
+            int w = ++_weights[j];
+            _merged[j].x += (tip.x - _merged[j].x) / w;
+            _merged[j].y += (tip.y - _merged[j].y) / w;
+        }
+    }
+}
+
+/**
+ * Solves the assignment problem on the n by n matrix in _cost, row major,
+ * leaving the column of every row in _assignment
+ *
+ * This is the Hungarian method in its O(n^3) form with row and column
+ * potentials, see e.g. Kuhn (1955) and Munkres (1957). n is the number of
+ * fingers on screen, so the cubic cost is nothing next to the rest of a frame
+ */
+
+void TipTracker::assign(int n)
+{
+    const double inf = std::numeric_limits<double>::infinity();
+
+    // the method counts from one, row and column zero are sentinels
+    _u.assign(n + 1, 0);
+    _v.assign(n + 1, 0);
+    _p.assign(n + 1, 0);
+    _way.assign(n + 1, 0);
+
+    for (int i = 1; i <= n; ++i) {
+        _p[0] = i;
+        int j0 = 0;
+        _minv.assign(n + 1, inf);
+        _used.assign(n + 1, false);
+
+        // grow an alternating path from row i until it reaches a free column
+        do {
+            _used[j0] = true;
+            int i0 = _p[j0];
+            int j1 = 0;
+            double delta = inf;
+
+            for (int j = 1; j <= n; ++j) {
+                if (_used[j]) {
+                    continue;
+                }
+
+                double cur = _cost[(i0 - 1) * n + (j - 1)] - _u[i0] - _v[j];
+                if (cur < _minv[j]) {
+                    _minv[j] = cur;
+                    _way[j] = j0;
+                }
+                if (_minv[j] < delta) {
+                    delta = _minv[j];
+                    j1 = j;
+                }
+            }
+
+            for (int j = 0; j <= n; ++j) {
+                if (_used[j]) {
+                    _u[_p[j]] += delta;
+                    _v[j] -= delta;
+                }
+                else {
+                    _minv[j] -= delta;
+                }
+            }
+            j0 = j1;
+        } while (_p[j0] != 0);
+
+        // flip the path
+        do {
+            int j1 = _way[j0];
+            _p[j0] = _p[j1];
+            j0 = j1;
+        } while (j0);
+    }
+
+    _assignment.assign(n, -1);
+    for (int j = 1; j <= n; ++j) {
+        _assignment[_p[j] - 1] = j - 1;
+    }
+}
+
+/**
+ * Matches the tips found in a frame to the tracks
+ *
+ * time is when the frame was captured, in seconds. Each track is compared
+ * with its tips where its filter predicts the tip to be by now, so a fast
+ * finger is not mistaken for a new one. The cost matrix is padded to a
+ * square, and a pair too far apart costs as much as leaving both unmatched,
+ * so the assignment never prefers it
+ */
+
+const std::vector<TipTrack>& TipTracker::update(const std::vector<Point>& tips, double time)
+{
+    dedupe(tips);
+
+    int tracks = (int)_tracks.size();
+    int found = (int)_merged.size();
+    int n = std::max(tracks, found);
+    double unmatched = _maxDistance + 1;
+
+    _cost.assign(n * n, unmatched);
+    for (int i = 0; i < tracks; ++i) {
+        Point2f expected = _tracks[i].filter.predict(time - _tracks[i].seen);
+        for (int j = 0; j < found; ++j) {
+            double dx = expected.x - _merged[j].x;
+            double dy = expected.y - _merged[j].y;
+            double distance = std::sqrt(dx * dx + dy * dy);
+            if (distance <= _maxDistance) {
+                _cost[i * n + j] = distance;
+            }
+        }
+    }
+
+    if (n > 0) {
+        assign(n);
+    }
+
+    // mark the tips a track took, the rest start tracks of their own
+    _used.assign(found, false);
+
+    for (int i = 0; i < tracks; ++i) {
+        TipTrack& track = _tracks[i];
+        int j = _assignment[i];
+
+        if (j < found && _cost[i * n + j] <= _maxDistance) {
+            _used[j] = true;
+            track.filter.update(_merged[j], time);
+            track.seen = time;
+            track.misses = 0;
+            if (++track.hits >= _birthFrames) {
+                track.confirmed = true;
+            }
+        }
+        else {
+            ++track.misses;
+        }
+    }
+
+    // a tentative track is dropped the first time it is missed, a confirmed
+    // one only after _deathFrames misses
+    size_t kept = 0;
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        const TipTrack& track = _tracks[i];
+        if (track.misses == 0 || (track.confirmed && track.misses <= _deathFrames)) {
+            _tracks[kept++] = track;
+        }
+    }
+    _tracks.resize(kept);
+
+    for (int j = 0; j < found; ++j) {
+        if (_used[j]) {
+            continue;
+        }
+
+        TipTrack track;
+        track.id = _nextId++;
+        track.hits = 1;
+        track.misses = 0;
+        track.confirmed = _birthFrames <= 1;
+        track.seen = time;
+        track.filter = TipFilter(_engine);
+        track.filter.update(_merged[j], time);
+        _tracks.push_back(track);
+    }
+
+    return _tracks;
+}
+
+/**
+ * Returns the current tracks
+ */
+
+const std::vector<TipTrack>& TipTracker::tracks() const
+{
+    return _tracks;
+}
+
+/**
+ * Returns the track with the id given, or 0 if it has been dropped
+ */
+
+const TipTrack* TipTracker::find(int id) const
+{
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        if (_tracks[i].id == id) {
+            return &_tracks[i];
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the confirmed track seen in the last frame with the most hits, or
+ * 0 if there is none
+ */
+
+const TipTrack* TipTracker::oldest() const
+{
+    const TipTrack* best = 0;
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        const TipTrack& track = _tracks[i];
+        if (track.confirmed && track.misses == 0 && (!best || track.hits > best->hits)) {
+            best = &track;
+        }
+    }
+    return best;
+}
+
+/**
+ * Drops every track
+ *
+ * The ids keep counting, so a finger found again is never mistaken for the
+ * one that was lost
+ */
+
+void TipTracker::clear()
+{
+    _tracks.clear();
+}
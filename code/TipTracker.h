@@ -0,0 +1,102 @@
+#ifndef TIPTRACKER_H
+#define TIPTRACKER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+
+#include "TipFilter.h"
+
+using namespace cv;
+
+// a finger tip followed from frame to frame
+struct TipTrack
+{
+    // unique for the life of the tracker, a finger keeps its id while it is tracked
+    int id;
+
+    // the frames the tip has been seen in, and the frames since it was last seen
+    int hits;
+    int misses;
+
+    // true once the tip has been seen in enough frames in a row to be trusted
+    bool confirmed;
+
+    // the capture time of the last frame the tip was seen in, in seconds
+    double seen;
+
+    // smooths the tip, position and predict give where it is
+    TipFilter filter;
+};
+
+/**
+ * The TipTracker class
+ *
+ * This gives the finger tips Detect finds an identity that lasts from frame
+ * to frame, so the finger that draws stays the same finger
+ *
+ * Tips closer together than the dedupe radius are merged first, since every
+ * finger can show up as the ends of two convexity defects. The tips are then
+ * matched to the tracks by an optimal (Hungarian) assignment on the distance
+ * from where each track expects its tip to be, and a pair further apart than
+ * maxDistance is never matched. A tip no track claims starts a new track,
+ * which is only confirmed after it is seen in birthFrames frames in a row, and
+ * a confirmed track survives deathFrames frames without its tip before it is
+ * dropped, so a single missed or spurious detection does not break a stroke
+ */
+
+class TipTracker
+{
+    private:
+        const double _maxDistance;
+        const int _birthFrames;
+        const int _deathFrames;
+        const double _dedupeRadius;
+        const TipFilterEngine _engine;
+
+        int _nextId;
+        std::vector<TipTrack> _tracks;
+
+        // the merged tips, and how many were merged into each
+        std::vector<Point2f> _merged;
+        std::vector<int> _weights;
+
+        // the assignment's cost matrix and result, and the Hungarian method's scratch
+        std::vector<double> _cost;
+        std::vector<int> _assignment;
+        std::vector<double> _u, _v, _minv;
+        std::vector<int> _p, _way;
+        std::vector<char> _used;
+
+        // merges the tips closer together than the dedupe radius into _merged
+        void dedupe(const std::vector<Point>& tips);
+
+        // matches the rows of the square cost matrix to its columns at the least total cost
+        void assign(int n);
+
+    public:
+        TipTracker(double maxDistance = 60, int birthFrames = 3, int deathFrames = 5,
+                   double dedupeRadius = 10, TipFilterEngine engine = TIP_FILTER_ONE_EURO);
+        ~TipTracker();
+
+        // matches the tips found in a frame captured at the time given, in seconds
+        const std::vector<TipTrack>& update(const std::vector<Point>& tips, double time);
+
+        // the current tracks, confirmed or not
+        const std::vector<TipTrack>& tracks() const;
+
+        // the track with the id given, or 0 if it is gone
+        const TipTrack* find(int id) const;
+
+        // the confirmed track seen in the last frame that has been tracked longest, or 0
+        const TipTrack* oldest() const;
+
+        // drops every track
+        void clear();
+};
+
+#endif // TIPTRACKER_H
@@ -0,0 +1,333 @@
+#include "Trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <mutex>
+
+// the events every thread's ring holds
+static const int TRACE_CAPACITY = 8192;
+
+/**
+ * a slot of a ring
+ *
+ * The fields are atomics, so a reader copying a slot the owner is
+ * overwriting reads a mix of two events rather than racing on it, and the
+ * reader throws such slots away
+ */
+
+struct TraceSlot
+{
+    std::atomic<const char*> name;
+    std::atomic<int64> start;
+    std::atomic<int64> end;
+};
+
+/**
+ * the ring of one thread
+ *
+ * Only the thread that owns the ring writes its slots and its head, and
+ * every reader holds the registry lock, which also guards where the last
+ * clear and the last summary left off
+ */
+
+struct TraceRing
+{
+    TraceRing(int thread) :
+        thread(thread),
+        head(0),
+        cleared(0),
+        summarized(0)
+    {}
+
+    const int thread;
+
+    // the number of events ever recorded, the next one goes in slot head % TRACE_CAPACITY
+    std::atomic<int64> head;
+
+    // the head as of the last clear, and the last summary
+    int64 cleared;
+    int64 summarized;
+
+    TraceSlot slots[TRACE_CAPACITY];
+};
+
+// every ring there is, rings are never freed so the events of a thread that
+// has ended can still be written out
+static std::mutex registryMutex;
+static std::vector<TraceRing*> rings;
+
+// the ring of the calling thread, g++ 4.7 has no thread_local
+static __thread TraceRing* threadRing = 0;
+
+static std::atomic<bool> tracing(false);
+
+/**
+ * returns the ring of the calling thread, making it on the thread's first
+ * event
+ */
+
+static TraceRing* ring()
+{
+    if (!threadRing) {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        threadRing = new TraceRing((int)rings.size());
+        rings.push_back(threadRing);
+    }
+    return threadRing;
+}
+
+/**
+ * appends the events of a ring from the one numbered from onward
+ *
+ * The owner may be recording while this reads, so the head is read again
+ * afterwards, and every event that was overwritten in the meantime, or may
+ * be in the middle of being overwritten, is dropped. Returns the head the
+ * copy went up to. The registry lock has to be held
+ */
+
+static int64 copyRing(const TraceRing& r, int64 from, std::vector<TraceEvent>& events)
+{
+    int64 head = r.head.load(std::memory_order_acquire);
+    int64 first = std::max(from, head - TRACE_CAPACITY);
+    size_t base = events.size();
+
+    for (int64 i = first; i < head; ++i) {
+        const TraceSlot& slot = r.slots[i % TRACE_CAPACITY];
+        TraceEvent event;
+        event.name = slot.name.load(std::memory_order_relaxed);
+        event.thread = r.thread;
+        event.start = slot.start.load(std::memory_order_relaxed);
+        event.end = slot.end.load(std::memory_order_relaxed);
+        events.push_back(event);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    int64 safe = r.head.load(std::memory_order_relaxed) + 1 - TRACE_CAPACITY;
+    if (safe > first) {
+        size_t stale = (size_t)std::min(safe - first, head - first);
+        events.erase(events.begin() + base, events.begin() + base + stale);
+    }
+    return head;
+}
+
+/**
+ * the p-th percentile (0 - 100) of sorted samples, by nearest rank the way
+ * LatencyStats does it
+ */
+
+static double nearestRank(const std::vector<double>& sorted, double p)
+{
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+/**
+ * Switches the scoped timers on or off
+ */
+
+void setTracing(bool on)
+{
+    tracing.store(on, std::memory_order_relaxed);
+}
+
+/**
+ * Returns whether the scoped timers record
+ */
+
+bool isTracing()
+{
+    return tracing.load(std::memory_order_relaxed);
+}
+
+/**
+ * Records a span on the calling thread's ring
+ *
+ * The slot is filled before the head moves past it, and the head is stored
+ * with release, so a reader that sees the new head sees the whole event. The
+ * fence keeps the slot from being overwritten before the head of the last
+ * event is out, so a reader that sees part of this event also sees a head
+ * that tells it to drop it
+ */
+
+void traceEvent(const char* name, int64 start, int64 end)
+{
+    TraceRing* r = ring();
+    int64 head = r->head.load(std::memory_order_relaxed);
+    TraceSlot& slot = r->slots[head % TRACE_CAPACITY];
+
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.start.store(start, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    r->head.store(head + 1, std::memory_order_release);
+}
+
+/**
+ * Copies the events the rings still hold into the vector given
+ *
+ * The events come thread by thread, each thread's oldest first, and only
+ * the ones recorded since the last clear
+ */
+
+void traceEvents(std::vector<TraceEvent>& events)
+{
+    events.clear();
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t i = 0; i < rings.size(); ++i) {
+        copyRing(*rings[i], rings[i]->cleared, events);
+    }
+}
+
+/**
+ * Forgets every event recorded so far
+ *
+ * Nothing is written to the rings, the readers just start from their heads
+ * as they are now
+ */
+
+void clearTrace()
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (size_t i = 0; i < rings.size(); ++i) {
+        rings[i]->cleared = rings[i]->head.load(std::memory_order_acquire);
+        rings[i]->summarized = rings[i]->cleared;
+    }
+}
+
+/**
+ * Writes the events the rings still hold to a file in the Chrome trace event
+ * format
+ *
+ * Every event is a complete ("X") event on the thread that recorded it,
+ * timed in microseconds from the earliest one
+ */
+
+bool writeChromeTrace(const std::string& path)
+{
+    std::vector<TraceEvent> events;
+    traceEvents(events);
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    int64 origin = 0;
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (i == 0 || events[i].start < origin) {
+            origin = events[i].start;
+        }
+    }
+
+    double usPerTick = 1e6 / getTickFrequency();
+
+    fprintf(file, "{\"traceEvents\":[");
+    for (size_t i = 0; i < events.size(); ++i) {
+        const TraceEvent& event = events[i];
+        fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                i > 0 ? "," : "", event.name, event.thread,
+                (event.start - origin) * usPerTick, (event.end - event.start) * usPerTick);
+    }
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+    return fclose(file) == 0;
+}
+
+/**
+ * Prints a table of every stage recorded since the last summary
+ *
+ * Meant to be called every few hundred frames, so it sorts and allocates
+ * freely. A stage that overflowed its ring since the last summary only
+ * counts the events the ring still holds
+ */
+
+void printTraceSummary(std::ostream& out)
+{
+    std::vector<TraceEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (size_t i = 0; i < rings.size(); ++i) {
+            TraceRing& r = *rings[i];
+            r.summarized = copyRing(r, std::max(r.cleared, r.summarized), events);
+        }
+    }
+
+    double msPerTick = 1000.0 / getTickFrequency();
+    std::map<std::string, std::vector<double> > stages;
+    for (size_t i = 0; i < events.size(); ++i) {
+        stages[events[i].name].push_back((events[i].end - events[i].start) * msPerTick);
+    }
+
+    char line[128];
+    snprintf(line, sizeof(line), "%-22s %8s %10s %10s %10s %10s\n",
+             "stage", "count", "p50 (ms)", "p95 (ms)", "p99 (ms)", "max (ms)");
+    out << line;
+
+    std::map<std::string, std::vector<double> >::iterator it;
+    for (it = stages.begin(); it != stages.end(); ++it) {
+        std::vector<double>& samples = it->second;
+        std::sort(samples.begin(), samples.end());
+        snprintf(line, sizeof(line), "%-22s %8d %10.3f %10.3f %10.3f %10.3f\n",
+                 it->first.c_str(), (int)samples.size(), nearestRank(samples, 50),
+                 nearestRank(samples, 95), nearestRank(samples, 99), samples.back());
+        out << line;
+    }
+}
+
+/**
+ * The constructor for TraceScope
+ *
+ * Starts a span of the stage named, which has to be a string literal since
+ * only the pointer is kept
+ */
+
+TraceScope::TraceScope(const char* name) :
+    _name(name),
+    _start(isTracing() ? getTickCount() : 0)
+{}
+
+/**
+ * The destructor for TraceScope
+ *
+ * Ends the span
+ */
+
+TraceScope::~TraceScope()
+{
+    end();
+}
+
+/**
+ * Records the span, unless tracing was off when it started
+ */
+
+void TraceScope::end()
+{
+    if (_start != 0) {
+        traceEvent(_name, _start, getTickCount());
+    }
+}
+
+/**
+ * Ends the span and starts one of the stage named
+ *
+ * The new span starts where the last one ended, so a run of stages covers
+ * the time of the function without gaps
+ */
+
+void TraceScope::next(const char* name)
+{
+    if (_start != 0) {
+        int64 now = getTickCount();
+        traceEvent(_name, _start, now);
+        _start = now;
+    }
+    else if (isTracing()) {
+        _start = getTickCount();
+    }
+    _name = name;
+}
@@ -0,0 +1,95 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+using namespace cv;
+
+/**
+ * The hot path trace
+ *
+ * Preprocess and Detect time each stage of a frame with a TraceScope. Every
+ * thread records into a ring buffer of its own, so recording takes no lock
+ * and shares no cache line with another thread: it is a tick count, three
+ * relaxed stores and a release store of the ring's head. Once a ring is full
+ * the oldest events are overwritten, so a long session keeps its last few
+ * thousand events per thread and never grows
+ *
+ * Tracing starts switched off, and while it is off a TraceScope costs a
+ * single relaxed load. The rings can be read at any time from any thread,
+ * either written out as a Chrome trace (chrome://tracing or Perfetto) or
+ * summed up as percentiles per stage
+ */
+
+// a span of time a thread spent in a named stage
+struct TraceEvent
+{
+    // the stage, always a string literal
+    const char* name;
+
+    // the thread, numbered in the order threads first recorded
+    int thread;
+
+    // getTickCount at the start and the end of the span
+    int64 start;
+    int64 end;
+};
+
+// switches recording on or off, it starts off
+void setTracing(bool on);
+
+// whether the scoped timers record
+bool isTracing();
+
+// records a span on the calling thread's ring, whether or not tracing is on
+void traceEvent(const char* name, int64 start, int64 end);
+
+// copies the events the rings still hold, thread by thread and oldest first
+void traceEvents(std::vector<TraceEvent>& events);
+
+// forgets every event recorded so far
+void clearTrace();
+
+// writes the events the rings still hold as a Chrome trace, false if the file could not be written
+bool writeChromeTrace(const std::string& path);
+
+// prints the count and the p50, p95, p99 and max milliseconds of every stage
+// recorded since the last summary
+void printTraceSummary(std::ostream& out);
+
+/**
+ * The TraceScope class
+ *
+ * Records the time from its construction to its destruction as a span of
+ * the stage named. next ends the span and starts one of another stage, so a
+ * run of stages in one function takes a single TraceScope
+ */
+
+class TraceScope
+{
+    private:
+        const char* _name;
+
+        // zero when tracing was off as the span started
+        int64 _start;
+
+        // records the span, if it is being traced
+        void end();
+
+    public:
+        TraceScope(const char* name);
+        ~TraceScope();
+
+        // ends the span and starts one of the stage named
+        void next(const char* name);
+};
+
+#endif // TRACE_H
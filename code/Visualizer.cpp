@@ -0,0 +1,129 @@
+#include "Visualizer.h"
+
+/**
+ * The constructor for Visualizer
+ *
+ * enabled is whether anything is drawn to begin with
+ */
+
+Visualizer::Visualizer(bool enabled) :
+    _enabled(enabled)
+{}
+
+/**
+ * The destructor for Visualizer
+ *
+ * As of now this does nothing
+ */
+
+Visualizer::~Visualizer()
+{}
+
+/**
+ * Turns the drawing on or off, which does nothing when built headless
+ */
+
+void Visualizer::setEnabled(bool enabled)
+{
+    _enabled = enabled;
+}
+
+/**
+ * Returns whether drawing is on
+ */
+
+bool Visualizer::isEnabled() const
+{
+#ifdef HEADLESS
+    return false;
+#else
+    return _enabled;
+#endif
+}
+
+/**
+ * Draws the hand over the frame
+ *
+ * These are the overlays Detect used to draw itself: the palm and the
+ * enclosing circle in blue, the contour in green, its hull in dark blue, the
+ * deepest point of each defect and the finger tips in white. The frame is
+ * mirrored afterwards so it matches the whiteboard
+ */
+
+void Visualizer::draw(Mat& frame, const Hand& hand)
+{
+#ifndef HEADLESS
+    if (!_enabled) {
+        return;
+    }
+
+    drawHand(frame, hand);
+    flip(frame, frame, 1);
+#endif
+}
+
+/**
+ * Draws every hand over the frame, the same way as a single one, and
+ * mirrors it once they are all drawn
+ */
+
+void Visualizer::draw(Mat& frame, const vector<Hand>& hands)
+{
+#ifndef HEADLESS
+    if (!_enabled) {
+        return;
+    }
+
+    for (size_t i = 0; i < hands.size(); ++i) {
+        drawHand(frame, hands[i]);
+    }
+    flip(frame, frame, 1);
+#endif
+}
+
+/**
+ * Draws the overlays of a single hand
+ */
+
+void Visualizer::drawHand(Mat& frame, const Hand& hand)
+{
+#ifndef HEADLESS
+    circle(frame, hand.palm.first, hand.palm.second, Scalar(220, 75, 20), 1, CV_AA);
+    circle(frame, hand.enclosing.first, hand.enclosing.second, Scalar(220, 75, 20), 1, CV_AA);
+
+    if (!hand.contour.empty()) {
+        const Point* points = &hand.contour[0];
+        int count = (int)hand.contour.size();
+        polylines(frame, &points, &count, 1, true, Scalar(0, 255, 0), 2);
+    }
+
+    if (!hand.hull.empty()) {
+        const Point* points = &hand.hull[0];
+        int count = (int)hand.hull.size();
+        polylines(frame, &points, &count, 1, true, Scalar(255, 0, 0), 2);
+    }
+
+    for (size_t i = 0; i < hand.defects.size(); ++i) {
+        circle(frame, hand.contour[hand.defects[i][2]], 4, Scalar(255, 255, 255), -1);
+    }
+
+    for (size_t i = 0; i < hand.tips.size(); ++i) {
+        circle(frame, hand.tips[i], 10, Scalar(255, 255, 255), 2);
+    }
+#endif
+}
+
+/**
+ * Shows the frame in the window given, if drawing is on
+ *
+ * This has to be called from the main thread
+ */
+
+void Visualizer::show(const std::string& window, const Mat& frame)
+{
+#ifndef HEADLESS
+    if (_enabled) {
+        imshow(window, frame);
+    }
+#endif
+}
@@ -0,0 +1,58 @@
+#ifndef VISUALIZER_H
+#define VISUALIZER_H
+
+// ========
+// includes
+// ========
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv/cv.h>
+
+#include <string>
+
+#include "Detect.h"
+
+/**
+ * The Visualizer class
+ *
+ * This draws what Detect found over the camera frame, for debugging
+ *
+ * The palm and enclosing circles, the contour, its hull, the defects and the
+ * finger tips are drawn and the frame is mirrored, the same way as the
+ * whiteboard. Everything here can be turned off when it is constructed or
+ * later on, and building with -DHEADLESS compiles the drawing out entirely,
+ * so a run without a display pays nothing for it
+ */
+
+using namespace cv;
+
+class Visualizer
+{
+    private:
+        bool _enabled;
+
+        // draws a single hand over the frame, without mirroring it
+        void drawHand(Mat& frame, const Hand& hand);
+
+    public:
+        Visualizer(bool enabled = true);
+        ~Visualizer();
+
+        // turns the drawing on or off
+        void setEnabled(bool enabled);
+
+        // true if draw and show do anything, never when built headless
+        bool isEnabled() const;
+
+        // draws the hand over the frame and mirrors it
+        void draw(Mat& frame, const Hand& hand);
+
+        // draws every hand over the frame and mirrors it
+        void draw(Mat& frame, const vector<Hand>& hands);
+
+        // shows the frame in a window of the name given
+        void show(const std::string& window, const Mat& frame);
+};
+
+#endif // VISUALIZER_H
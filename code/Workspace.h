@@ -0,0 +1,70 @@
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+// ========
+// includes
+// ========
+
+#include <utility>
+#include <vector>
+
+/**
+ * The VectorPool class
+ *
+ * Keeps the memory of the inner vectors of a vector of vectors alive between
+ * frames
+ *
+ * Clearing a vector<vector<Point>> frees every inner vector, so refilling it
+ * on the next frame allocates all over again. Going through a pool instead,
+ * cleared inner vectors are moved aside with their capacity intact, and
+ * handed back out when the next frame adds a vector. Once the pool has seen
+ * the largest frame, adding vectors allocates nothing
+ */
+
+template<typename T>
+class VectorPool
+{
+    private:
+        std::vector<std::vector<T>> _spare;
+
+    public:
+        // empties the vectors, keeping their inner vectors for later
+        void clear(std::vector<std::vector<T>>& vectors)
+        {
+            while (!vectors.empty()) {
+                drop(vectors);
+            }
+        }
+
+        // appends an empty inner vector, reusing a spare one when there is one
+        std::vector<T>& add(std::vector<std::vector<T>>& vectors)
+        {
+            if (_spare.empty()) {
+                vectors.push_back(std::vector<T>());
+            }
+            else {
+                vectors.push_back(std::move(_spare.back()));
+                _spare.pop_back();
+                vectors.back().clear();
+            }
+            return vectors.back();
+        }
+
+        // removes the last inner vector, keeping it for later
+        void drop(std::vector<std::vector<T>>& vectors)
+        {
+            _spare.push_back(std::move(vectors.back()));
+            vectors.pop_back();
+        }
+
+        // removes the inner vector at index i, keeping it for later
+        void erase(std::vector<std::vector<T>>& vectors, size_t i)
+        {
+            for (; i + 1 < vectors.size(); ++i) {
+                std::swap(vectors[i], vectors[i + 1]);
+            }
+            drop(vectors);
+        }
+};
+
+#endif // WORKSPACE_H